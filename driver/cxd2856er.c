@@ -39,16 +39,105 @@ int cxd2856er_read_regs(struct cxd2856er_demod *demod,
 	return i2c_comm_master_request(demod->i2c, req, 2);
 }
 
-int cxd2856er_write_regs(struct cxd2856er_demod *demod,
-			 enum cxd2856er_i2c_target target,
-			 u8 reg, u8 *buf, int len)
+static void cxd2856er_invalidate_shadow(struct cxd2856er_demod *demod)
+{
+	memset(&demod->shadow, 0, sizeof(demod->shadow));
+}
+
+static void cxd2856er_invalidate_shadow_target(struct cxd2856er_demod *demod,
+					       enum cxd2856er_i2c_target target)
+{
+	struct cxd2856er_shadow *shadow = &demod->shadow;
+	int i, n = 0;
+
+	shadow->bank_valid[target] = false;
+
+	for (i = 0; i < shadow->num; i++) {
+		if (shadow->regs[i].target != target)
+			shadow->regs[n++] = shadow->regs[i];
+	}
+
+	shadow->num = n;
+}
+
+static int cxd2856er_find_shadow(struct cxd2856er_demod *demod,
+				 enum cxd2856er_i2c_target target, u8 reg)
+{
+	struct cxd2856er_shadow *shadow = &demod->shadow;
+	int i;
+
+	if (!shadow->bank_valid[target])
+		return -1;
+
+	for (i = 0; i < shadow->num; i++) {
+		if (shadow->regs[i].target == target &&
+		    shadow->regs[i].bank == shadow->bank[target] &&
+		    shadow->regs[i].reg == reg)
+			return i;
+	}
+
+	return -1;
+}
+
+static void cxd2856er_update_shadow(struct cxd2856er_demod *demod,
+				    enum cxd2856er_i2c_target target,
+				    u8 reg, const u8 *buf, int len, bool add)
+{
+	struct cxd2856er_shadow *shadow = &demod->shadow;
+	int i;
+
+	for (i = 0; i < len && reg + i < 256; i++) {
+		u8 r = reg + i;
+		int idx;
+
+		if (!r) {
+			/* bank select */
+			shadow->bank[target] = buf[i];
+			shadow->bank_valid[target] = true;
+			continue;
+		}
+
+		if ((target == CXD2856ER_I2C_SLVX && r == 0x10) ||
+		    (target == CXD2856ER_I2C_SLVT && r == 0xfe)) {
+			/* system or soft reset */
+			cxd2856er_invalidate_shadow_target(demod, target);
+			continue;
+		}
+
+		if (!shadow->bank_valid[target])
+			continue;
+
+		idx = cxd2856er_find_shadow(demod, target, r);
+		if (idx < 0) {
+			if (!add || shadow->num >= CXD2856ER_SHADOW_NUM)
+				continue;
+
+			idx = shadow->num++;
+			shadow->regs[idx].target = target;
+			shadow->regs[idx].bank = shadow->bank[target];
+			shadow->regs[idx].reg = r;
+		}
+
+		shadow->regs[idx].val = buf[i];
+	}
+}
+
+static int cxd2856er_write_regs_shadow(struct cxd2856er_demod *demod,
+				       enum cxd2856er_i2c_target target,
+				       u8 reg, u8 *buf, int len, bool add)
 {
+	int ret = 0;
 	u8 b[255], addr;
 	struct i2c_comm_request req[1];
 
 	if (!buf || !len || len > 254)
 		return -EINVAL;
 
+	if (demod->config.use_shadow && !reg && len == 1 &&
+	    demod->shadow.bank_valid[target] &&
+	    demod->shadow.bank[target] == buf[0])
+		return 0;
+
 	b[0] = reg;
 	memcpy(&b[1], buf, len);
 
@@ -60,20 +149,46 @@ int cxd2856er_write_regs(struct cxd2856er_demod *demod,
 	req[0].data = b;
 	req[0].len = 1 + len;
 
-	return i2c_comm_master_request(demod->i2c, req, 1);
+	ret = i2c_comm_master_request(demod->i2c, req, 1);
+
+	if (!demod->config.use_shadow)
+		return ret;
+
+	if (ret)
+		cxd2856er_invalidate_shadow_target(demod, target);
+	else
+		cxd2856er_update_shadow(demod, target, reg, buf, len, add);
+
+	return ret;
+}
+
+int cxd2856er_write_regs(struct cxd2856er_demod *demod,
+			 enum cxd2856er_i2c_target target,
+			 u8 reg, u8 *buf, int len)
+{
+	return cxd2856er_write_regs_shadow(demod, target, reg, buf, len, false);
 }
 
 int cxd2856er_write_reg_mask(struct cxd2856er_demod *demod,
 			     enum cxd2856er_i2c_target target,
 			     u8 reg, u8 val, u8 mask)
 {
-	int ret = 0;
+	int ret = 0, idx = -1;
 	u8 tmp;
 
 	if (!mask)
 		return -EINVAL;
 
-	if (mask != 0xff) {
+	if (demod->config.use_shadow)
+		idx = cxd2856er_find_shadow(demod, target, reg);
+
+	if (idx >= 0) {
+		u8 cur = demod->shadow.regs[idx].val;
+
+		tmp = (cur & ~mask) | (val & mask);
+		if (tmp == cur)
+			return 0;
+	} else if (mask != 0xff) {
 		ret = cxd2856er_read_regs(demod, target, reg, &tmp, 1);
 		if (ret)
 			return ret;
@@ -84,7 +199,7 @@ int cxd2856er_write_reg_mask(struct cxd2856er_demod *demod,
 		tmp = val;
 	}
 
-	return cxd2856er_write_regs(demod, target, reg, &tmp, 1);
+	return cxd2856er_write_regs_shadow(demod, target, reg, &tmp, 1, true);
 }
 
 static int cxd2856er_i2c_master_gate_ctrl(void *i2c_priv, bool open)
@@ -124,6 +239,8 @@ int cxd2856er_init(struct cxd2856er_demod *demod)
 	demod->state = CXD2856ER_UNKNOWN_STATE;
 	demod->system = CXD2856ER_UNSPECIFIED_SYSTEM;
 
+	cxd2856er_invalidate_shadow(demod);
+
 	ret = cxd2856er_write_slvx_reg(demod, 0x00, 0x00);
 	if (ret)
 		return ret;
@@ -537,6 +654,9 @@ int cxd2856er_sleep(struct cxd2856er_demod *demod)
 	demod->state = CXD2856ER_SLEEP_STATE;
 	demod->system = CXD2856ER_UNSPECIFIED_SYSTEM;
 
+	/* the register values are not tracked while sleeping */
+	cxd2856er_invalidate_shadow(demod);
+
 	return 0;
 }
 
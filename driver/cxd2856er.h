@@ -18,9 +18,12 @@
 
 #include "i2c_comm.h"
 
+#define CXD2856ER_SHADOW_NUM	32
+
 struct cxd2856er_config {
 	u32 xtal;
 	bool tuner_i2c;
+	bool use_shadow;	// skip bank switches and reads of known registers
 };
 
 enum cxd2856er_state {
@@ -44,6 +47,18 @@ union cxd2856er_system_params {
 	u32 bandwidth;
 };
 
+struct cxd2856er_shadow {
+	bool bank_valid[2];
+	u8 bank[2];
+	int num;
+	struct {
+		u8 target;
+		u8 bank;
+		u8 reg;
+		u8 val;
+	} regs[CXD2856ER_SHADOW_NUM];
+};
+
 struct cxd2856er_demod {
 	const struct device *dev;
 	const struct i2c_comm_master *i2c;
@@ -55,6 +70,7 @@ struct cxd2856er_demod {
 	struct cxd2856er_config config;
 	enum cxd2856er_state state;
 	enum cxd2856er_system system;
+	struct cxd2856er_shadow shadow;
 };
 
 #ifdef __cplusplus
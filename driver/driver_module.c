@@ -12,7 +12,10 @@
 #include <linux/module.h>
 
 #include "revision.h"
+#include "ptx_lock_wait.h"
 #include "px4_usb.h"
+#include "r850_cal_cache.h"
+#include "it930x_fw_cache.h"
 #include "firmware.h"
 
 int init_module(void)
@@ -40,9 +43,13 @@ int init_module(void)
 #endif
 		"\n");
 
+	ptx_lock_wait_debugfs_init();
+
 	ret = px4_usb_register();
-	if (ret)
+	if (ret) {
+		ptx_lock_wait_debugfs_exit();
 		return ret;
+	}
 
 	return 0;
 }
@@ -50,6 +57,9 @@ int init_module(void)
 void cleanup_module(void)
 {
 	px4_usb_unregister();
+	r850_cal_cache_clear();
+	it930x_fw_cache_clear();
+	ptx_lock_wait_debugfs_exit();
 }
 
 MODULE_VERSION(PX4_DRV_VERSION);
@@ -13,7 +13,9 @@
 #include <linux/slab.h>
 
 #include "px4_device_params.h"
+#include "ts_sync.h"
 #include "firmware.h"
+#include "ptx_lock_wait.h"
 
 #define ISDB2056_DEVICE_TS_SYNC_COUNT	4
 #define ISDB2056_DEVICE_TS_SYNC_SIZE	(188 * ISDB2056_DEVICE_TS_SYNC_COUNT)
@@ -22,6 +24,8 @@ struct isdb2056_stream_context {
 	struct ptx_chrdev *chrdev;
 	u8 remain_buf[ISDB2056_DEVICE_TS_SYNC_SIZE];
 	size_t remain_len;
+	bool direct;
+	u32 direct_size;
 };
 
 static void isdb2056_device_release(struct kref *kref);
@@ -118,33 +122,23 @@ static void isdb2056_device_stream_process(struct ptx_chrdev *chrdev,
 	u32 remain = *len;
 
 	while (likely(remain)) {
-		u32 i = 0;
-		bool sync_remain = false;
-
-		while (true) {
-			if (likely(((i + 1) * 188) <= remain)) {
-				if (unlikely(p[i * 188] != 0x47))
-					break;
-			} else {
-				sync_remain = true;
-				break;
-			}
-			i++;
-		}
+		u32 i;
 
-		if (unlikely(i < ISDB2056_DEVICE_TS_SYNC_COUNT)) {
-			p++;
-			remain--;
-			continue;
-		}
+		i = ts_sync_search(p, remain, 0xff, 0x47, ISDB2056_DEVICE_TS_SYNC_COUNT);
+		p += i;
+		remain -= i;
+
+		if (unlikely(remain < ISDB2056_DEVICE_TS_SYNC_SIZE))
+			break;
+
+		i = ISDB2056_DEVICE_TS_SYNC_COUNT;
+		while (likely(((i + 1) * 188) <= remain && p[i * 188] == 0x47))
+			i++;
 
 		ptx_chrdev_put_stream(chrdev, p, 188 * i);
 
 		p += 188 * i;
 		remain -= 188 * i;
-
-		if (unlikely(sync_remain))
-			break;
 	}
 
 	*buf = p;
@@ -153,6 +147,84 @@ static void isdb2056_device_stream_process(struct ptx_chrdev *chrdev,
 	return;
 }
 
+static int isdb2056_device_stream_direct(struct isdb2056_stream_context *stream_ctx,
+					 u8 *buf, u32 len)
+{
+	int ret = 0;
+	u32 size = stream_ctx->direct_size, pad = 0;
+	u8 *p = buf, *q = buf;
+	u32 remain = len, i;
+
+	if (likely(len == size && !stream_ctx->remain_len)) {
+		for (i = 0; i < len; i += 188) {
+			if (unlikely(buf[i] != 0x47))
+				break;
+		}
+
+		if (likely(i >= len))
+			goto commit;
+	}
+
+	/* resynchronize in place and fill the rest with null packets */
+	stream_ctx->remain_len = 0;
+
+	while (likely(remain)) {
+		i = ts_sync_search(p, remain, 0xff, 0x47, ISDB2056_DEVICE_TS_SYNC_COUNT);
+		p += i;
+		remain -= i;
+
+		if (unlikely(remain < ISDB2056_DEVICE_TS_SYNC_SIZE))
+			break;
+
+		i = ISDB2056_DEVICE_TS_SYNC_COUNT;
+		while (likely(((i + 1) * 188) <= remain && p[i * 188] == 0x47))
+			i++;
+
+		if (q != p)
+			memmove(q, p, 188 * i);
+
+		q += 188 * i;
+		p += 188 * i;
+		remain -= 188 * i;
+	}
+
+	/* the missing packets are counted as dropped */
+	pad = (buf + size) - q;
+
+	for (; q < buf + size; q += 188) {
+		q[0] = 0x47;
+		q[1] = 0x1f;
+		q[2] = 0xff;
+		q[3] = 0x10;
+		memset(q + 4, 0xff, 184);
+	}
+
+	ptx_chrdev_count_dropped(stream_ctx->chrdev, pad);
+
+commit:
+	ret = ptx_chrdev_commit_stream_buffer(stream_ctx->chrdev, buf, size);
+	if (unlikely(ret)) {
+		/* -ECANCELED: an earlier commit has failed */
+		if (ret != -ECANCELED)
+			dev_err_ratelimited(stream_ctx->chrdev->parent->dev,
+					    "isdb2056_device_stream_direct: ptx_chrdev_commit_stream_buffer() failed. (ret: %d)\n",
+					    ret);
+
+		/* the buffers in flight are handed back, then the copy path takes over */
+		ptx_chrdev_release_stream_buffer(stream_ctx->chrdev, size);
+		ptx_chrdev_count_dropped(stream_ctx->chrdev, size - pad);
+	}
+
+	return 0;
+}
+
+static void *isdb2056_device_stream_buffer_handler(void *context, u32 len)
+{
+	struct isdb2056_stream_context *stream_ctx = context;
+
+	return ptx_chrdev_get_stream_buffer(stream_ctx->chrdev, len);
+}
+
 static int isdb2056_device_stream_handler(void *context, void *buf, u32 len)
 {
 	struct isdb2056_stream_context *stream_ctx = context;
@@ -161,6 +233,10 @@ static int isdb2056_device_stream_handler(void *context, void *buf, u32 len)
 	u8 *p = buf;
 	u32 remain = len;
 
+	if (stream_ctx->direct &&
+	    ptx_chrdev_is_stream_buffer(stream_ctx->chrdev, buf))
+		return isdb2056_device_stream_direct(stream_ctx, buf, len);
+
 	if (unlikely(ctx_remain_len)) {
 		if (likely((ctx_remain_len + len) >= ISDB2056_DEVICE_TS_SYNC_SIZE)) {
 			u32 t = ISDB2056_DEVICE_TS_SYNC_SIZE - ctx_remain_len;
@@ -359,12 +435,14 @@ static int isdb2056_chrdev_release(struct ptx_chrdev *chrdev)
 static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 				struct ptx_tune_params *params)
 {
-	int ret = 0, i;
+	int ret = 0;
+	struct ptx_lock_wait wait;
 	struct ptx_chrdev_group *chrdev_group = chrdev->parent;
 	struct isdb2056_chrdev *chrdev2056 = chrdev->priv;
 	struct isdb2056_device *isdb2056 = container_of(chrdev2056,
 							struct isdb2056_device,
 							chrdev2056);
+	struct tc90522_regbuf regbuf[3];
 	bool tuner_locked;
 	s32 ss;
 
@@ -373,7 +451,7 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 
 	switch (params->system) {
 	case PTX_ISDB_T_SYSTEM:
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x47, 0x30);
+		ret = tc90522_write_reg_cached(&chrdev2056->tc90522_t, 0x47, 0x30);
 		if (ret)
 			break;
 
@@ -393,15 +471,11 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x0e, 0x77);
-		if (ret)
-			break;
-
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x0f, 0x10);
-		if (ret)
-			break;
+		tc90522_regbuf_set_val(&regbuf[0], 0x0e, 0x77);
+		tc90522_regbuf_set_val(&regbuf[1], 0x0f, 0x10);
+		tc90522_regbuf_set_val(&regbuf[2], 0x71, 0x20);
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x71, 0x20);
+		ret = tc90522_write_multiple_regs(&chrdev2056->tc90522_t, regbuf, 3);
 		if (ret)
 			break;
 
@@ -413,11 +487,11 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x76, 0x0c);
+		ret = tc90522_write_reg_cached(&chrdev2056->tc90522_t, 0x76, 0x0c);
 		if (ret)
 			break;
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x1f, 0x30);
+		ret = tc90522_write_reg_cached(&chrdev2056->tc90522_t, 0x1f, 0x30);
 		if (ret)
 			break;
 
@@ -437,15 +511,16 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		i = 50;
-		while (i--) {
+		ptx_lock_wait_start(&wait, 500);
+		do {
 			ret = r850_is_pll_locked(&chrdev2056->r850,
 						 &tuner_locked);
 			if (!ret && tuner_locked)
 				break;
+		} while (ptx_lock_wait_next(&wait));
 
-			msleep(10);
-		}
+		ptx_lock_wait_record(&wait, PTX_ISDB_T_SYSTEM,
+				     PTX_LOCK_STAGE_PLL, !ret && tuner_locked);
 
 		if (ret) {
 			dev_err(isdb2056->dev,
@@ -462,8 +537,8 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 		}
 
 		dev_dbg(isdb2056->dev,
-			"isdb2056_chrdev_tune %u: PLL is locked. count: %d\n",
-			chrdev_group->id, i);
+			"isdb2056_chrdev_tune %u: PLL is locked. elapsed: %ums\n",
+			chrdev_group->id, ptx_lock_wait_elapsed(&wait));
 
 		ret = tc90522_set_agc_t(&chrdev2056->tc90522_t, true);
 		if (ret) {
@@ -473,15 +548,11 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x71, 0x01);
-		if (ret)
-			break;
+		tc90522_regbuf_set_val(&regbuf[0], 0x71, 0x01);
+		tc90522_regbuf_set_val(&regbuf[1], 0x72, 0x25);
+		tc90522_regbuf_set_val(&regbuf[2], 0x75, 0x00);
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x72, 0x25);
-		if (ret)
-			break;
-
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x75, 0x00);
+		ret = tc90522_write_multiple_regs(&chrdev2056->tc90522_t, regbuf, 3);
 		if (ret)
 			break;
 
@@ -498,11 +569,10 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x0e, 0x11);
-		if (ret)
-			break;
+		tc90522_regbuf_set_val(&regbuf[0], 0x0e, 0x11);
+		tc90522_regbuf_set_val(&regbuf[1], 0x0f, 0x70);
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x0f, 0x70);
+		ret = tc90522_write_multiple_regs(&chrdev2056->tc90522_t, regbuf, 2);
 		if (ret)
 			break;
 
@@ -514,11 +584,10 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_s, 0x07, 0x77);
-		if (ret)
-			break;
+		tc90522_regbuf_set_val(&regbuf[0], 0x07, 0x77);
+		tc90522_regbuf_set_val(&regbuf[1], 0x08, 0x10);
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_s, 0x08, 0x10);
+		ret = tc90522_write_multiple_regs(&chrdev2056->tc90522_s, regbuf, 2);
 		if (ret)
 			break;
 
@@ -534,11 +603,11 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 		if (ret)
 			break;
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_s, 0x8e, 0x02);
+		ret = tc90522_write_reg_cached(&chrdev2056->tc90522_s, 0x8e, 0x02);
 		if (ret)
 			break;
 
-		ret = tc90522_write_reg(&chrdev2056->tc90522_t, 0x1f, 0x20);
+		ret = tc90522_write_reg_cached(&chrdev2056->tc90522_t, 0x1f, 0x20);
 		if (ret)
 			break;
 
@@ -551,15 +620,16 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 			break;
 		}
 
-		i = 50;
-		while (i--) {
+		ptx_lock_wait_start(&wait, 500);
+		do {
 			ret = rt710_is_pll_locked(&chrdev2056->rt710,
 						  &tuner_locked);
 			if (!ret && tuner_locked)
 				break;
+		} while (ptx_lock_wait_next(&wait));
 
-			msleep(10);
-		}
+		ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM,
+				     PTX_LOCK_STAGE_PLL, !ret && tuner_locked);
 
 		if (ret) {
 			dev_err(isdb2056->dev,
@@ -577,8 +647,9 @@ static int isdb2056_chrdev_tune(struct ptx_chrdev *chrdev,
 
 		rt710_get_rf_signal_strength(&chrdev2056->rt710, &ss);
 		dev_dbg(isdb2056->dev,
-			"isdb2056_chrdev_tune %u: PLL is locked. count: %d, signal strength: %d.%03ddBm\n",
-			chrdev_group->id, i, ss / 1000, -ss % 1000);
+			"isdb2056_chrdev_tune %u: PLL is locked. elapsed: %ums, signal strength: %d.%03ddBm\n",
+			chrdev_group->id, ptx_lock_wait_elapsed(&wait),
+			ss / 1000, -ss % 1000);
 
 		ret = tc90522_set_agc_s(&chrdev2056->tc90522_s, true);
 		if (ret) {
@@ -625,7 +696,8 @@ static int isdb2056_chrdev_check_lock(struct ptx_chrdev *chrdev, bool *locked)
 static int isdb2056_chrdev_set_stream_id(struct ptx_chrdev *chrdev,
 					 u16 stream_id)
 {
-	int ret = 0, i;
+	int ret = 0;
+	struct ptx_lock_wait wait;
 	struct ptx_chrdev_group *chrdev_group = chrdev->parent;
 	struct isdb2056_chrdev *chrdev2056 = chrdev->priv;
 	struct isdb2056_device *isdb2056 = container_of(chrdev2056,
@@ -641,15 +713,16 @@ static int isdb2056_chrdev_set_stream_id(struct ptx_chrdev *chrdev,
 		return -EINVAL;
 
 	if (stream_id < 12) {
-		i = 100;
-		while (i--) {
+		ptx_lock_wait_start(&wait, 1000);
+		do {
 			ret = tc90522_tmcc_get_tsid_s(tc90522_s,
 						      stream_id, &tsid);
 			if ((!ret && tsid) || ret == -EINVAL)
 				break;
+		} while (ptx_lock_wait_next(&wait));
 
-			msleep(10);
-		}
+		ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM,
+				     PTX_LOCK_STAGE_TMCC, !ret && tsid);
 
 		if (ret) {
 			dev_err(isdb2056->dev,
@@ -676,14 +749,15 @@ static int isdb2056_chrdev_set_stream_id(struct ptx_chrdev *chrdev,
 
 	/* check slot */
 
-	i = 100;
-	while(i--) {
+	ptx_lock_wait_start(&wait, 1000);
+	do {
 		ret = tc90522_get_tsid_s(tc90522_s, &tsid2);
 		if (!ret && tsid2 == tsid)
 			break;
+	} while (ptx_lock_wait_next(&wait));
 
-		msleep(10);
-	}
+	ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM, PTX_LOCK_STAGE_SLOT,
+			     !ret && tsid2 == tsid);
 
 	if (tsid2 != tsid)
 		ret = -EAGAIN;
@@ -700,7 +774,7 @@ static int isdb2056_chrdev_start_capture(struct ptx_chrdev *chrdev)
 							struct isdb2056_device,
 							chrdev2056);
 	struct isdb2056_stream_context *stream_ctx = isdb2056->stream_ctx;
-
+	struct itedtv_bus *bus = &isdb2056->it930x.bus;
 
 	dev_dbg(isdb2056->dev,
 		"isdb2056_chrdev_start_capture %u\n", chrdev_group->id);
@@ -741,10 +815,21 @@ static int isdb2056_chrdev_start_capture(struct ptx_chrdev *chrdev)
 		goto fail_tc;
 
 	stream_ctx->remain_len = 0;
-
-	ret = itedtv_bus_start_streaming(&isdb2056->it930x.bus,
-					 isdb2056_device_stream_handler,
-					 stream_ctx);
+	stream_ctx->direct = (px4_device_params.direct_streaming &&
+			      ptx_chrdev_check_stream_buffer(chrdev,
+							     bus->usb.streaming.urb_buffer_size,
+							     bus->usb.streaming.urb_num));
+	stream_ctx->direct_size = bus->usb.streaming.urb_buffer_size;
+
+	if (stream_ctx->direct)
+		ret = itedtv_bus_start_streaming_direct(bus,
+							isdb2056_device_stream_handler,
+							isdb2056_device_stream_buffer_handler,
+							stream_ctx);
+	else
+		ret = itedtv_bus_start_streaming(bus,
+						 isdb2056_device_stream_handler,
+						 stream_ctx);
 	if (ret) {
 		dev_err(isdb2056->dev,
 			"isdb2056_chrdev_start_capture %u: itedtv_bus_start_streaming() failed. (ret: %d)\n",
@@ -812,6 +897,17 @@ static int isdb2056_chrdev_set_capture(struct ptx_chrdev *chrdev, bool status)
 			: isdb2056_chrdev_stop_capture(chrdev);
 }
 
+static int isdb2056_chrdev_read_signal_strength(struct ptx_chrdev *chrdev,
+						u32 *value)
+{
+	struct isdb2056_chrdev *chrdev2056 = chrdev->priv;
+
+	if (chrdev->current_system != PTX_ISDB_S_SYSTEM)
+		return -EINVAL;
+
+	return rt710_get_rf_signal_strength(&chrdev2056->rt710, (s32 *)value);
+}
+
 static int isdb2056_chrdev_read_cnr_raw(struct ptx_chrdev *chrdev, u32 *value)
 {
 	int ret = 0;
@@ -834,6 +930,21 @@ static int isdb2056_chrdev_read_cnr_raw(struct ptx_chrdev *chrdev, u32 *value)
 	return ret;
 }
 
+static int isdb2056_chrdev_set_pid_filter(struct ptx_chrdev *chrdev,
+					  const struct ptx_pid_filter *filter)
+{
+	struct isdb2056_chrdev *chrdev2056 = chrdev->priv;
+	struct isdb2056_device *isdb2056 = container_of(chrdev2056,
+							struct isdb2056_device,
+							chrdev2056);
+
+	return it930x_set_pid_list(&isdb2056->it930x, 0,
+				   filter && filter->block,
+				   (filter) ? filter->pid : NULL,
+				   (filter) ? filter->num : 0,
+				   px4_device_params.discard_null_packets);
+}
+
 static struct ptx_chrdev_operations isdb2056_chrdev_ops = {
 	.init = isdb2056_chrdev_init,
 	.term = isdb2056_chrdev_term,
@@ -844,9 +955,10 @@ static struct ptx_chrdev_operations isdb2056_chrdev_ops = {
 	.set_stream_id = isdb2056_chrdev_set_stream_id,
 	.set_lnb_voltage = NULL,
 	.set_capture = isdb2056_chrdev_set_capture,
-	.read_signal_strength = NULL,
+	.read_signal_strength = isdb2056_chrdev_read_signal_strength,
 	.read_cnr = NULL,
-	.read_cnr_raw = isdb2056_chrdev_read_cnr_raw
+	.read_cnr_raw = isdb2056_chrdev_read_cnr_raw,
+	.set_pid_filter = isdb2056_chrdev_set_pid_filter
 };
 
 static int isdb2056_device_load_config(struct isdb2056_device *isdb2056,
@@ -884,11 +996,13 @@ static int isdb2056_device_load_config(struct isdb2056_device *isdb2056,
 	chrdev2056->tc90522_t.i2c = &it930x->i2c_master[2];
 	chrdev2056->tc90522_t.i2c_addr = 0x10;
 	chrdev2056->tc90522_t.is_secondary = false;
+	chrdev2056->tc90522_t.use_shadow = px4_device_params.reg_shadow;
 
 	chrdev2056->tc90522_s.dev = dev;
 	chrdev2056->tc90522_s.i2c = &it930x->i2c_master[2];
 	chrdev2056->tc90522_s.i2c_addr = 0x11;
 	chrdev2056->tc90522_s.is_secondary = false;
+	chrdev2056->tc90522_s.use_shadow = px4_device_params.reg_shadow;
 
 	chrdev2056->r850.dev = dev;
 	chrdev2056->r850.i2c = &chrdev2056->tc90522_t.i2c_master;
@@ -973,9 +1087,20 @@ int isdb2056_device_init(struct isdb2056_device *isdb2056, struct device *dev,
 	chrdev_config.ops = &isdb2056_chrdev_ops;
 	chrdev_config.options = PTX_CHRDEV_WAIT_AFTER_LOCK_TC_T;
 	chrdev_config.ringbuf_size = 188 * px4_device_params.tsdev_max_packets;
+	chrdev_config.ringbuf_max_size = 188 * px4_device_params.tsdev_ringbuf_max_packets;
 	chrdev_config.ringbuf_threshold_size = chrdev_config.ringbuf_size / 10;
 	chrdev_config.priv = &isdb2056->chrdev2056;
 
+	if (px4_device_params.direct_streaming &&
+	    bus->usb.streaming.urb_buffer_size) {
+		/* the URB buffers must tile the ring buffer */
+		u32 urb_size = bus->usb.streaming.urb_buffer_size;
+
+		chrdev_config.ringbuf_size = roundup(chrdev_config.ringbuf_size,
+						     urb_size) +
+					     urb_size * bus->usb.streaming.urb_num;
+	}
+
 	ret = it930x_load_firmware(it930x, IT930X_FIRMWARE_FILENAME);
 	if (ret)
 		goto fail_device;
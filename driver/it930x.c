@@ -14,6 +14,12 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <linux/firmware.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#endif
+
+#ifdef __linux__
+#include "it930x_fw_cache.h"
 #endif
 
 struct it930x_i2c_master_info {
@@ -30,6 +36,8 @@ struct it930x_priv {
 	struct mutex ctrl_lock;
 	struct mutex i2c_lock;
 	struct mutex gpio_lock;
+	struct mutex pid_filter_lock;
+	int pid_filter_num[5];	/* number of enabled entries per port */
 	u8 *buf;
 	u8 seq;
 	struct it930x_i2c_master_info i2c[3];
@@ -237,6 +245,43 @@ int it930x_write_reg(struct it930x_bridge *it930x, u32 reg, u8 val)
 	return it930x_write_regs(it930x, reg, &val, 1);
 }
 
+int it930x_write_multiple_regs(struct it930x_bridge *it930x,
+			       struct it930x_regbuf *regbuf, int num)
+{
+	int ret = 0, i, n;
+	u8 buf[250 - 6];
+
+	if (!regbuf || !num)
+		return -EINVAL;
+
+	for (i = 0; i < num; i += n) {
+		u32 reg = regbuf[i].reg;
+		int len = 0;
+
+		/* writes to consecutive registers are sent in one message */
+		for (n = 0; i + n < num; n++) {
+			struct it930x_regbuf *r = &regbuf[i + n];
+			int l = (r->buf) ? r->u.len : 1;
+
+			if (n && (r->reg != reg + len ||
+				  len + l > (int)sizeof(buf)))
+				break;
+
+			if (!l || l > (int)sizeof(buf))
+				return -EINVAL;
+
+			memcpy(&buf[len], (r->buf) ? r->buf : &r->u.val, l);
+			len += l;
+		}
+
+		ret = it930x_write_regs(it930x, reg, buf, (u8)len);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
 int it930x_write_reg_mask(struct it930x_bridge *it930x,
 			  u32 reg,
 			  u8 val, u8 mask)
@@ -561,6 +606,7 @@ int it930x_init(struct it930x_bridge *it930x)
 	mutex_init(&priv->ctrl_lock);
 	mutex_init(&priv->i2c_lock);
 	mutex_init(&priv->gpio_lock);
+	mutex_init(&priv->pid_filter_lock);
 
 	priv->buf = buf;
 
@@ -608,6 +654,7 @@ int it930x_term(struct it930x_bridge *it930x)
 	mutex_destroy(&priv->ctrl_lock);
 	mutex_destroy(&priv->i2c_lock);
 	mutex_destroy(&priv->gpio_lock);
+	mutex_destroy(&priv->pid_filter_lock);
 
 	kfree(priv);
 
@@ -633,7 +680,10 @@ int it930x_load_firmware(struct it930x_bridge *it930x, const char *filename)
 {
 	int ret = 0;
 	u32 fw_version;
+#ifndef __linux__
 	const struct firmware *fw;
+#endif
+	const u8 *data;
 	size_t i, n, len = 0;
 	struct it930x_ctrl_buf wb;
 
@@ -664,6 +714,18 @@ int it930x_load_firmware(struct it930x_bridge *it930x, const char *filename)
 		return ret;
 	}
 
+#ifdef __linux__
+	/* the image is loaded once and its blocks are already coalesced */
+	ret = it930x_fw_cache_get(filename, it930x->dev, &data, &n);
+	if (ret) {
+		dev_err(it930x->dev,
+			"it930x_load_firmware: it930x_fw_cache_get() failed. (ret: %d)\n",
+			ret);
+		dev_err(it930x->dev,
+			"Couldn't load firmware from the file.\n");
+		return ret;
+	}
+#else
 	ret = request_firmware(&fw, filename, it930x->dev);
 	if (ret) {
 		dev_err(it930x->dev,
@@ -674,10 +736,12 @@ int it930x_load_firmware(struct it930x_bridge *it930x, const char *filename)
 		return ret;
 	}
 
+	data = fw->data;
 	n = fw->size;
+#endif
 
 	for (i = 0; i < n; i += len) {
-		const u8 *p = &fw->data[i];
+		const u8 *p = &data[i];
 		unsigned j, m = p[3];
 
 		len = 0;
@@ -746,14 +810,90 @@ int it930x_load_firmware(struct it930x_bridge *it930x, const char *filename)
 		 (fw_version >> 8) & 0xff, fw_version & 0xff);
 
 exit:
+#ifndef __linux__
 	release_firmware(fw);
+#endif
+
+	return ret;
+}
+
+#ifdef __linux__
+static int it930x_test_ctrl_delay(struct it930x_bridge *it930x)
+{
+	static const int delays[] = { 1000, 500, 250, 100, 50, 20, 0 };
+	struct itedtv_bus *bus = &it930x->bus;
+	int ret = 0, ctrl_delay = bus->usb.ctrl_delay, safe = -1, i, j;
+
+	for (i = 0; i < ARRAY_SIZE(delays); i++) {
+		int n = 0;
+		u8 val = 0;
+		ktime_t begin;
+
+		bus->usb.ctrl_delay = delays[i];
+		begin = ktime_get();
+
+		/* write back the i2c speed and read it again */
+		for (j = 0; j < 32; j++) {
+			ret = it930x_write_reg(it930x, 0xf103,
+					       it930x->config.i2c_speed);
+			if (ret)
+				break;
+
+			n++;
+
+			ret = it930x_read_reg(it930x, 0xf103, &val);
+			if (ret)
+				break;
+
+			n++;
+
+			if (val != it930x->config.i2c_speed) {
+				ret = -EIO;
+				break;
+			}
+		}
+
+		dev_info(it930x->dev,
+			 "it930x_test_ctrl_delay: delay: %d us, result: %s, %lld us/msg (ret: %d)\n",
+			 delays[i], (ret) ? "NG" : "OK",
+			 (n) ? div_s64(ktime_us_delta(ktime_get(), begin), n) : 0,
+			 ret);
+
+		if (ret)
+			break;
+
+		safe = delays[i];
+	}
+
+	/* the configured delay is used from now on, whatever the result is */
+	bus->usb.ctrl_delay = ctrl_delay;
+
+	if (safe < 0)
+		dev_warn(it930x->dev,
+			 "it930x_test_ctrl_delay: No safe delay was found.\n");
+	else
+		dev_info(it930x->dev,
+			 "it930x_test_ctrl_delay: minimum safe delay: %d us\n",
+			 safe);
+
+	if (!ret)
+		return 0;
+
+	/* make sure that the bridge still works with the configured delay */
+	ret = it930x_write_reg(it930x, 0xf103, it930x->config.i2c_speed);
+	if (ret)
+		dev_err(it930x->dev,
+			"it930x_test_ctrl_delay: it930x_write_reg(0xf103) failed. (ret: %d)\n",
+			ret);
 
 	return ret;
 }
+#endif
 
 int it930x_init_warm(struct it930x_bridge *it930x)
 {
 	int ret = 0;
+	struct it930x_regbuf regbuf[3];
 
 	if (it930x->bus.type != ITEDTV_BUS_USB) {
 		dev_dbg(it930x->dev,
@@ -811,15 +951,11 @@ int it930x_init_warm(struct it930x_bridge *it930x)
 	if (ret)
 		return ret;
 
-	ret = it930x_write_reg(it930x, 0xd830, 0);
-	if (ret)
-		return ret;
+	it930x_regbuf_set_val(&regbuf[0], 0xd830, 0);
+	it930x_regbuf_set_val(&regbuf[1], 0xd831, 1);
+	it930x_regbuf_set_val(&regbuf[2], 0xd832, 0);
 
-	ret = it930x_write_reg(it930x, 0xd831, 1);
-	if (ret)
-		return ret;
-
-	ret = it930x_write_reg(it930x, 0xd832, 0);
+	ret = it930x_write_multiple_regs(it930x, regbuf, 3);
 	if (ret)
 		return ret;
 
@@ -839,6 +975,15 @@ int it930x_init_warm(struct it930x_bridge *it930x)
 		return ret;
 	}
 
+#ifdef __linux__
+	/* before any chrdev of the device is exposed */
+	if (it930x->config.ctrl_delay_test) {
+		ret = it930x_test_ctrl_delay(it930x);
+		if (ret)
+			return ret;
+	}
+#endif
+
 	return 0;
 }
 
@@ -1061,69 +1206,109 @@ int it930x_set_pid_filter(struct it930x_bridge *it930x, int input_idx,
 		0xda2e,
 		0xda80
 	};
-	int ret = 0, i;
+	int ret = 0, i, num;
+	struct it930x_priv *priv = it930x->priv;
 	u8 port, data[2];
 
 	if (input_idx < 0 || input_idx > 4)
 		return -EINVAL;
 
+	if (filter && (filter->num < 0 ||
+		       filter->num > (int)ARRAY_SIZE(filter->pid)))
+		return -EINVAL;
+
 	port = it930x->config.input[input_idx].port_number;
 
+	mutex_lock(&priv->pid_filter_lock);
+
 	if (!filter || !filter->num) {
 		/* disable pid filter */
 
 		ret = it930x_write_reg(it930x, remap_mode_regs[port], 0);
 		if (ret)
-			return ret;
+			goto exit;
 
 		/* sync_byte only */
 		ret = it930x_write_reg(it930x, 0xda73 + port, 1);
-		if (ret)
-			return ret;
-
-		return 0;
+		goto exit;
 	}
 
-	for (i = 0; i < filter->num; i++) {
-		data[0] = filter->pid[i] & 0xff;
-		data[1] = (filter->pid[i] >> 8) & 0xff;
+	num = (filter->num > priv->pid_filter_num[port]) ? filter->num
+							: priv->pid_filter_num[port];
 
-		/* target pid */
-		ret = it930x_write_regs(it930x, 0xda16, data, 2);
-		if (ret)
-			return ret;
+	for (i = 0; i < num; i++) {
+		bool enable = (i < filter->num);
+
+		if (enable) {
+			data[0] = filter->pid[i] & 0xff;
+			data[1] = (filter->pid[i] >> 8) & 0xff;
 
-		/* enable */
-		ret = it930x_write_reg(it930x, 0xda14, 1);
+			/* target pid */
+			ret = it930x_write_regs(it930x, 0xda16, data, 2);
+			if (ret)
+				goto exit;
+		}
+
+		/* enable, or disable the entries left from a previous filter */
+		/* the enable and index writes are not merged, they trigger the update */
+		ret = it930x_write_reg(it930x, 0xda14, (enable) ? 1 : 0);
 		if (ret)
-			return ret;
+			goto exit;
 
 		/* index */
 		ret = it930x_write_reg(it930x, pid_index_regs[port], i);
 		if (ret)
-			return ret;
+			goto exit;
 	}
 
+	priv->pid_filter_num[port] = filter->num;
+
 	/* block or pass */
 	ret = it930x_write_reg(it930x, remap_mode_regs[port],
 			       (filter->block) ? 0 : 2);
 	if (ret)
-		return ret;
+		goto exit;
 
 	/* sync_byte and remap */
 	ret = it930x_write_reg(it930x, 0xda73 + port, 3);
 	if (ret)
-		return ret;
+		goto exit;
 
 	data[0] = 0;
 	data[1] = 0;
 
 	/* pid offset */
 	ret = it930x_write_regs(it930x, 0xda81 + (port * 2), data, 2);
-	if (ret)
-		return ret;
 
-	return 0;
+exit:
+	mutex_unlock(&priv->pid_filter_lock);
+	return ret;
+}
+
+/* pid == NULL restores the default, which drops the null packets if requested */
+int it930x_set_pid_list(struct it930x_bridge *it930x, int input_idx,
+			bool block, const u16 *pid, int num,
+			bool discard_null_packets)
+{
+	struct it930x_pid_filter filter;
+
+	if (pid) {
+		if (num < 0 || num > (int)ARRAY_SIZE(filter.pid))
+			return -EINVAL;
+
+		filter.block = block;
+		filter.num = num;
+		memcpy(filter.pid, pid, sizeof(filter.pid[0]) * num);
+	} else if (discard_null_packets) {
+		filter.block = true;
+		filter.num = 1;
+		filter.pid[0] = 0x1fff;
+	} else {
+		filter.block = false;
+		filter.num = 0;
+	}
+
+	return it930x_set_pid_filter(it930x, input_idx, &filter);
 }
 
 int it930x_purge_psb(struct it930x_bridge *it930x, int timeout)
@@ -38,6 +38,31 @@ struct it930x_pid_filter {
 	u16 pid[64];
 };
 
+struct it930x_regbuf {
+	u32 reg;
+	u8 *buf;
+	union {
+		u8 val;
+		u8 len;
+	} u;
+};
+
+static inline void it930x_regbuf_set_val(struct it930x_regbuf *regbuf,
+					 u32 reg, u8 val)
+{
+	regbuf->reg = reg;
+	regbuf->buf = NULL;
+	regbuf->u.val = val;
+}
+
+static inline void it930x_regbuf_set_buf(struct it930x_regbuf *regbuf,
+					 u32 reg, u8 *buf, u8 len)
+{
+	regbuf->reg = reg;
+	regbuf->buf = buf;
+	regbuf->u.len = len;
+}
+
 struct it930x_stream_input {
 	bool enable;
 	bool is_parallel;
@@ -52,6 +77,7 @@ struct it930x_stream_input {
 struct it930x_config {
 	u32 xfer_size;
 	u8 i2c_speed;
+	bool ctrl_delay_test;	// for Linux, measure the minimum safe ctrl_delay in it930x_init_warm()
 	struct it930x_stream_input input[5];
 };
 
@@ -74,6 +100,8 @@ int it930x_write_regs(struct it930x_bridge *it930x,
 		      u32 reg,
 		      u8 *wbuf, u8 len);
 int it930x_write_reg(struct it930x_bridge *it930x, u32 reg, u8 val);
+int it930x_write_multiple_regs(struct it930x_bridge *it930x,
+			       struct it930x_regbuf *regbuf, int num);
 int it930x_write_reg_mask(struct it930x_bridge *it930x,
 			  u32 reg,
 			  u8 val, u8 mask);
@@ -93,6 +121,9 @@ int it930x_read_gpio(struct it930x_bridge *it930x, int gpio, bool *high);
 int it930x_write_gpio(struct it930x_bridge *it930x, int gpio, bool high);
 int it930x_set_pid_filter(struct it930x_bridge *it930x, int input_idx,
 			  struct it930x_pid_filter *filter);
+int it930x_set_pid_list(struct it930x_bridge *it930x, int input_idx,
+			bool block, const u16 *pid, int num,
+			bool discard_null_packets);
 int it930x_purge_psb(struct it930x_bridge *it930x, int timeout);
 #ifdef __cplusplus
 }
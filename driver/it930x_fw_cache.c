@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * IT930x firmware cache (it930x_fw_cache.c)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#include "print_format.h"
+#include "it930x_fw_cache.h"
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/firmware.h>
+
+/* maximum length of the data of IT930X_CMD_FW_SCATTER_WRITE */
+#define IT930X_FW_BLOCK_MAX	250
+
+struct it930x_fw_cache_entry {
+	struct list_head list;
+	char *filename;
+	u8 *data;
+	size_t size;
+};
+
+struct it930x_fw_block {
+	u8 type;
+	u8 param[2];
+	u8 num;
+	size_t hdr_len;
+	size_t data_len;
+	u8 hdr[IT930X_FW_BLOCK_MAX];
+	u8 data[IT930X_FW_BLOCK_MAX];
+};
+
+static LIST_HEAD(fw_cache_list);
+static DEFINE_MUTEX(fw_cache_lock);
+
+static size_t it930x_fw_cache_flush_block(struct it930x_fw_block *blk, u8 *dst)
+{
+	if (!blk->num)
+		return 0;
+
+	dst[0] = blk->type;
+	dst[1] = blk->param[0];
+	dst[2] = blk->param[1];
+	dst[3] = blk->num;
+	memcpy(&dst[4], blk->hdr, blk->hdr_len);
+	memcpy(&dst[4 + blk->hdr_len], blk->data, blk->data_len);
+
+	return 4 + blk->hdr_len + blk->data_len;
+}
+
+static int it930x_fw_cache_coalesce(struct device *dev,
+				    const u8 *src, size_t n,
+				    u8 *dst, size_t *len)
+{
+	int ret = 0;
+	struct it930x_fw_block *blk;
+	size_t i, out = 0, blen;
+
+	blk = kzalloc(sizeof(*blk), GFP_KERNEL);
+	if (!blk)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i += blen) {
+		const u8 *p = &src[i];
+		size_t hlen, dlen = 0;
+		unsigned int j, m;
+
+		if (n - i < 4 || p[0] != 0x03) {
+			dev_err(dev,
+				"it930x_fw_cache_coalesce: Invalid firmware block was found. Abort. (ofs: %zx)\n",
+				i);
+			ret = -ECANCELED;
+			goto exit;
+		}
+
+		m = p[3];
+		hlen = (size_t)m * 3;
+
+		if (n - i >= 4 + hlen) {
+			for (j = 0; j < m; j++)
+				dlen += p[6 + (j * 3)];
+		}
+
+		blen = 4 + hlen + dlen;
+		if (n - i < blen || blen > IT930X_FW_BLOCK_MAX) {
+			dev_err(dev,
+				"it930x_fw_cache_coalesce: Invalid firmware block length. Abort. (ofs: %zx, len: %zu)\n",
+				i, blen);
+			ret = -ECANCELED;
+			goto exit;
+		}
+
+		if (!dlen) {
+			dev_warn(dev,
+				 "it930x_fw_cache_coalesce: No data in the block. (ofs: %zx)\n",
+				 i);
+			continue;
+		}
+
+		/* append the segments to the pending block if they fit */
+		if (!blk->num ||
+		    blk->param[0] != p[1] || blk->param[1] != p[2] ||
+		    blk->num + m > 0xff ||
+		    4 + blk->hdr_len + hlen + blk->data_len + dlen > IT930X_FW_BLOCK_MAX) {
+			out += it930x_fw_cache_flush_block(blk, &dst[out]);
+
+			blk->type = p[0];
+			blk->param[0] = p[1];
+			blk->param[1] = p[2];
+			blk->num = 0;
+			blk->hdr_len = 0;
+			blk->data_len = 0;
+		}
+
+		memcpy(&blk->hdr[blk->hdr_len], &p[4], hlen);
+		memcpy(&blk->data[blk->data_len], &p[4 + hlen], dlen);
+		blk->num += m;
+		blk->hdr_len += hlen;
+		blk->data_len += dlen;
+	}
+
+	out += it930x_fw_cache_flush_block(blk, &dst[out]);
+	*len = out;
+
+exit:
+	kfree(blk);
+
+	return ret;
+}
+
+int it930x_fw_cache_get(const char *filename, struct device *dev,
+			const u8 **data, size_t *size)
+{
+	int ret = 0;
+	const struct firmware *fw;
+	struct it930x_fw_cache_entry *entry;
+
+	mutex_lock(&fw_cache_lock);
+
+	list_for_each_entry(entry, &fw_cache_list, list) {
+		if (!strcmp(entry->filename, filename))
+			goto exit;
+	}
+
+	ret = request_firmware(&fw, filename, dev);
+	if (ret) {
+		dev_err(dev,
+			"it930x_fw_cache_get: request_firmware() failed. (ret: %d)\n",
+			ret);
+		goto exit;
+	}
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry) {
+		ret = -ENOMEM;
+		goto exit_with_release;
+	}
+
+	entry->filename = kstrdup(filename, GFP_KERNEL);
+	entry->data = kmalloc(fw->size, GFP_KERNEL);
+	if (!entry->filename || !entry->data) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	/* the coalesced image is never larger than the original one */
+	ret = it930x_fw_cache_coalesce(dev, fw->data, fw->size,
+				       entry->data, &entry->size);
+	if (ret)
+		goto fail;
+
+	dev_dbg(dev,
+		"it930x_fw_cache_get: %s: %zu bytes, %zu bytes after coalescing\n",
+		filename, fw->size, entry->size);
+
+	list_add_tail(&entry->list, &fw_cache_list);
+	release_firmware(fw);
+
+exit:
+	if (!ret) {
+		*data = entry->data;
+		*size = entry->size;
+	}
+
+	mutex_unlock(&fw_cache_lock);
+
+	return ret;
+
+fail:
+	kfree(entry->data);
+	kfree(entry->filename);
+	kfree(entry);
+exit_with_release:
+	release_firmware(fw);
+	mutex_unlock(&fw_cache_lock);
+
+	return ret;
+}
+
+void it930x_fw_cache_clear(void)
+{
+	struct it930x_fw_cache_entry *entry, *tmp;
+
+	mutex_lock(&fw_cache_lock);
+
+	list_for_each_entry_safe(entry, tmp, &fw_cache_list, list) {
+		list_del(&entry->list);
+		kfree(entry->data);
+		kfree(entry->filename);
+		kfree(entry);
+	}
+
+	mutex_unlock(&fw_cache_lock);
+}
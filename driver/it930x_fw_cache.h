@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * IT930x firmware cache definitions (it930x_fw_cache.h)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#ifndef __IT930X_FW_CACHE_H__
+#define __IT930X_FW_CACHE_H__
+
+#include <linux/types.h>
+#include <linux/device.h>
+
+int it930x_fw_cache_get(const char *filename, struct device *dev,
+			const u8 **data, size_t *size);
+void it930x_fw_cache_clear(void);
+
+#endif
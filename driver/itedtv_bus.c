@@ -13,10 +13,12 @@
 #include <linux/kernel.h>
 #include <linux/atomic.h>
 #include <linux/slab.h>
-#endif
-
-#if defined(ITEDTV_BUS_USE_WORKQUEUE) && !defined(__linux__)
-#undef ITEDTV_BUS_USE_WORKQUEUE
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
 #endif
 
 struct itedtv_usb_context;
@@ -24,8 +26,14 @@ struct itedtv_usb_context;
 struct itedtv_usb_work {
 	struct itedtv_usb_context *ctx;
 	struct urb *urb;
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
+	void *buffer;
+#ifdef __linux__
+	dma_addr_t dma;
+	bool coherent;
+#endif
+#ifdef __linux__
 	struct work_struct work;
+	struct list_head node;
 #endif
 };
 
@@ -33,17 +41,34 @@ struct itedtv_usb_context {
 	struct mutex lock;
 	struct itedtv_bus *bus;
 	itedtv_bus_stream_handler_t stream_handler;
+	itedtv_bus_stream_buffer_handler_t buffer_handler;
 	void *ctx;
 	u32 num_urb;
 	bool no_dma;
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
+	enum itedtv_usb_handler_mode handler_mode;
+	int cpu;
+#ifdef __linux__
 	struct workqueue_struct *wq;
+	struct task_struct *thread;
+	spinlock_t thread_lock;
+	wait_queue_head_t thread_wait;
+	struct list_head thread_list;
 #endif
 	u32 num_works;
 	struct itedtv_usb_work *works;
 	atomic_t streaming;
 };
 
+static void itedtv_usb_ctrl_delay(struct itedtv_bus *bus)
+{
+#ifdef __linux__
+	int delay = bus->usb.ctrl_delay;
+
+	if (delay > 0)
+		usleep_range(delay, delay + (delay >> 2) + 10);
+#endif
+}
+
 static int itedtv_usb_ctrl_tx(struct itedtv_bus *bus, void *buf, int len)
 {
 	int ret = 0, rlen = 0;
@@ -58,7 +83,7 @@ static int itedtv_usb_ctrl_tx(struct itedtv_bus *bus, void *buf, int len)
 			   buf, len,
 			   &rlen, bus->usb.ctrl_timeout);
 
-	mdelay(1);
+	itedtv_usb_ctrl_delay(bus);
 
 	return ret;
 }
@@ -79,7 +104,7 @@ static int itedtv_usb_ctrl_rx(struct itedtv_bus *bus, void *buf, int *len)
 
 	*len = rlen;
 
-	mdelay(1);
+	itedtv_usb_ctrl_delay(bus);
 
 	return ret;
 }
@@ -105,77 +130,244 @@ static int itedtv_usb_stream_rx(struct itedtv_bus *bus,
 	return ret;
 }
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-static void itedtv_usb_workqueue_handler(struct work_struct *work)
+static void itedtv_usb_restore_urb_buffer(struct itedtv_usb_work *w)
+{
+	struct urb *urb = w->urb;
+
+	urb->transfer_buffer = w->buffer;
+#ifdef __linux__
+	if (w->coherent) {
+		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+		urb->transfer_dma = w->dma;
+	}
+#endif
+
+	return;
+}
+
+/* in direct mode, receive into the buffer provided by buffer_handler if any */
+static void itedtv_usb_prepare_urb_buffer(struct itedtv_usb_work *w)
+{
+	struct itedtv_usb_context *ctx = w->ctx;
+	struct urb *urb = w->urb;
+	void *p;
+
+	if (!ctx->buffer_handler)
+		return;
+
+	p = ctx->buffer_handler(ctx->ctx, urb->transfer_buffer_length);
+	if (p) {
+		urb->transfer_buffer = p;
+#ifdef __linux__
+		urb->transfer_flags &= ~URB_NO_TRANSFER_DMA_MAP;
+		urb->transfer_dma = 0;
+#endif
+	} else {
+		itedtv_usb_restore_urb_buffer(w);
+	}
+
+	return;
+}
+
+static bool itedtv_usb_is_direct_urb_buffer(struct itedtv_usb_work *w)
+{
+	return (w->urb->transfer_buffer != w->buffer);
+}
+
+static void itedtv_usb_process_urb(struct itedtv_usb_work *w, gfp_t mem_flags)
 {
 	int ret = 0;
-	struct itedtv_usb_work *w = container_of(work,
-						 struct itedtv_usb_work, work);
 	struct itedtv_usb_context *ctx = w->ctx;
 	struct urb *urb = w->urb;
 
-	if (likely(urb->actual_length))
+	/* a lent buffer must always be handed back to the stream handler */
+	if (likely(urb->actual_length) || itedtv_usb_is_direct_urb_buffer(w))
 		ret = ctx->stream_handler(ctx->ctx,
 					  urb->transfer_buffer,
 					  urb->actual_length);
 	else
 		dev_dbg(ctx->bus->dev,
-			"itedtv_usb_workqueue_handler: !urb->actual_length\n");
+			"itedtv_usb_process_urb: !urb->actual_length\n");
 
-	if (unlikely(ret || (atomic_read_acquire(&ctx->streaming) < 1)))
+	/* a failed URB is not submitted again */
+	if (unlikely(ret || urb->status ||
+		     (atomic_read_acquire(&ctx->streaming) < 1)))
 		return;
 
-	ret = usb_submit_urb(urb, GFP_KERNEL);
+	itedtv_usb_prepare_urb_buffer(w);
+
+	ret = usb_submit_urb(urb, mem_flags);
 	if (unlikely(ret))
 		dev_err(ctx->bus->dev,
-			"itedtv_usb_workqueue_handler: usb_submit_urb() failed. (ret: %d)\n",
+			"itedtv_usb_process_urb: usb_submit_urb() failed. (ret: %d)\n",
 			ret);
 
 	return;
 }
+
+#ifdef __linux__
+static void itedtv_usb_workqueue_handler(struct work_struct *work)
+{
+	struct itedtv_usb_work *w = container_of(work,
+						 struct itedtv_usb_work, work);
+
+	itedtv_usb_process_urb(w, GFP_KERNEL);
+}
+
+static int itedtv_usb_thread(void *data)
+{
+	struct itedtv_usb_context *ctx = data;
+	struct itedtv_usb_work *w, *tmp;
+	LIST_HEAD(list);
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(ctx->thread_wait,
+					 !list_empty_careful(&ctx->thread_list) ||
+					 kthread_should_stop());
+
+		spin_lock_irq(&ctx->thread_lock);
+		list_splice_tail_init(&ctx->thread_list, &list);
+		spin_unlock_irq(&ctx->thread_lock);
+
+		list_for_each_entry_safe(w, tmp, &list, node) {
+			list_del_init(&w->node);
+			itedtv_usb_process_urb(w, GFP_KERNEL);
+		}
+	}
+
+	return 0;
+}
 #endif
 
 static void itedtv_usb_complete(struct urb *urb)
 {
-#ifndef ITEDTV_BUS_USE_WORKQUEUE
-	int ret = 0;
-#endif
 	struct itedtv_usb_work *w = urb->context;
 	struct itedtv_usb_context *ctx = w->ctx;
+#ifdef __linux__
+	unsigned long flags;
+#endif
 
 	if (unlikely(urb->status)) {
 		dev_dbg(ctx->bus->dev,
 			"itedtv_usb_complete: status: %d\n",
 			urb->status);
-		return;
+
+		if (!itedtv_usb_is_direct_urb_buffer(w) ||
+		    atomic_read_acquire(&ctx->streaming) < 1)
+			return;
+
+		/*
+		 * the lent buffer goes through the same path as the other URBs
+		 * so that it is handed back in order
+		 */
+		urb->actual_length = 0;
 	}
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	if (unlikely(!queue_work(ctx->wq, &w->work)))
-		dev_err(ctx->bus->dev,
-			"itedtv_usb_complete: queue_work() failed.\n");
-#else
-	if (likely(urb->actual_length))
-		ret = ctx->stream_handler(ctx->ctx,
-					  urb->transfer_buffer,
-					  urb->actual_length);
-	else
-		dev_dbg(ctx->bus->dev,
-			"itedtv_usb_complete: !urb->actual_length\n");
+	switch (ctx->handler_mode) {
+#ifdef __linux__
+	case ITEDTV_USB_HANDLER_WORKQUEUE:
+		if (unlikely(!queue_work_on((ctx->cpu >= 0) ? ctx->cpu
+							    : WORK_CPU_UNBOUND,
+					    ctx->wq, &w->work)))
+			dev_err(ctx->bus->dev,
+				"itedtv_usb_complete: queue_work_on() failed.\n");
+		break;
 
-	if (unlikely(ret || (atomic_read_acquire(&ctx->streaming) < 1)))
-		return;
+	case ITEDTV_USB_HANDLER_THREAD:
+		spin_lock_irqsave(&ctx->thread_lock, flags);
+		list_add_tail(&w->node, &ctx->thread_list);
+		spin_unlock_irqrestore(&ctx->thread_lock, flags);
 
-	ret = usb_submit_urb(urb, GFP_ATOMIC);
-	if (unlikely(ret))
-		dev_err(ctx->bus->dev,
-			"itedtv_usb_complete: usb_submit_urb() failed. (ret: %d)\n",
-			ret);
+		wake_up(&ctx->thread_wait);
+		break;
 #endif
 
+	default:
+		itedtv_usb_process_urb(w, GFP_ATOMIC);
+		break;
+	}
+
 	return;
 }
 
+#ifdef __linux__
+static int itedtv_usb_start_handler(struct itedtv_usb_context *ctx)
+{
+	struct itedtv_bus *bus = ctx->bus;
+	int cpu = ctx->cpu;
+
+	switch (ctx->handler_mode) {
+	case ITEDTV_USB_HANDLER_WORKQUEUE:
+		if (ctx->wq)
+			break;
+
+		/* max_active 1 keeps the URBs in completion order */
+		if (cpu >= 0)
+			ctx->wq = alloc_workqueue("itedtv_usb/%s",
+						  WQ_HIGHPRI | WQ_MEM_RECLAIM, 1,
+						  dev_name(bus->dev));
+		else
+			ctx->wq = alloc_ordered_workqueue("itedtv_usb/%s",
+							  WQ_HIGHPRI | WQ_MEM_RECLAIM,
+							  dev_name(bus->dev));
+		if (!ctx->wq) {
+			dev_err(bus->dev,
+				"itedtv_usb_start_handler: alloc_workqueue() failed.\n");
+			return -ENOMEM;
+		}
+		break;
+
+	case ITEDTV_USB_HANDLER_THREAD:
+	{
+		struct task_struct *thread;
+
+		if (ctx->thread)
+			break;
+
+		thread = kthread_create(itedtv_usb_thread, ctx,
+					"itedtv_usb/%s", dev_name(bus->dev));
+		if (IS_ERR(thread)) {
+			dev_err(bus->dev,
+				"itedtv_usb_start_handler: kthread_create() failed. (ret: %ld)\n",
+				PTR_ERR(thread));
+			return PTR_ERR(thread);
+		}
+
+		if (cpu >= 0)
+			kthread_bind(thread, cpu);
+
+		ctx->thread = thread;
+		wake_up_process(thread);
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* must be called after all URBs have been killed */
+static void itedtv_usb_stop_handler(struct itedtv_usb_context *ctx)
+{
+	if (ctx->wq) {
+		flush_workqueue(ctx->wq);
+		destroy_workqueue(ctx->wq);
+		ctx->wq = NULL;
+	}
+
+	if (ctx->thread) {
+		kthread_stop(ctx->thread);
+		ctx->thread = NULL;
+	}
+
+	INIT_LIST_HEAD(&ctx->thread_list);
+
+	return;
+}
+#endif
+
 static int itedtv_usb_alloc_urb_buffers(struct itedtv_usb_context *ctx,
 					u32 buf_size)
 {
@@ -291,7 +483,11 @@ static int itedtv_usb_alloc_urb_buffers(struct itedtv_usb_context *ctx,
 					  p, buf_size,
 					  itedtv_usb_complete, &works[i]);
 
+			works[i].buffer = p;
 #ifdef __linux__
+			works[i].coherent = !no_dma;
+			works[i].dma = (!no_dma) ? dma : 0;
+
 			if (!no_dma) {
 				urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
 				urb->transfer_dma = dma;
@@ -299,8 +495,9 @@ static int itedtv_usb_alloc_urb_buffers(struct itedtv_usb_context *ctx,
 #endif
 		}
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
+#ifdef __linux__
 		INIT_WORK(&works[i].work, itedtv_usb_workqueue_handler);
+		INIT_LIST_HEAD(&works[i].node);
 #endif
 	}
 
@@ -330,6 +527,8 @@ static void itedtv_usb_free_urb_buffers(struct itedtv_usb_context *ctx,
 		if (!urb)
 			continue;
 
+		itedtv_usb_restore_urb_buffer(&works[i]);
+
 		if (urb->transfer_buffer) {
 #ifdef __linux__
 			if (!no_dma) {
@@ -349,6 +548,7 @@ static void itedtv_usb_free_urb_buffers(struct itedtv_usb_context *ctx,
 			urb->transfer_buffer = NULL;
 			urb->transfer_buffer_length = 0;
 			urb->actual_length = 0;
+			works[i].buffer = NULL;
 		}
 
 		if (free_urb) {
@@ -363,11 +563,30 @@ static void itedtv_usb_free_urb_buffers(struct itedtv_usb_context *ctx,
 	return;
 }
 
+/* URBs must not be resubmitted once this returns */
+static void itedtv_usb_kill_urbs(struct itedtv_usb_context *ctx, u32 num)
+{
+	u32 i;
+	struct itedtv_usb_work *works = ctx->works;
+
+	if (!works)
+		return;
+
+	for (i = 0; i < num; i++) {
+#ifdef __linux__
+		usb_poison_urb(works[i].urb);
+#else
+		usb_kill_urb(works[i].urb);
+#endif
+	}
+
+	return;
+}
+
 static void itedtv_usb_clean_context(struct itedtv_usb_context *ctx)
 {
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	if (ctx->wq)
-		destroy_workqueue(ctx->wq);
+#ifdef __linux__
+	itedtv_usb_stop_handler(ctx);
 #endif
 
 	if (ctx->works) {
@@ -376,21 +595,22 @@ static void itedtv_usb_clean_context(struct itedtv_usb_context *ctx)
 	}
 
 	ctx->stream_handler = NULL;
+	ctx->buffer_handler = NULL;
 	ctx->ctx = NULL;
 	ctx->num_urb = 0;
 	ctx->no_dma = false;
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	ctx->wq = NULL;
-#endif
+	ctx->handler_mode = ITEDTV_USB_HANDLER_COMPLETION;
+	ctx->cpu = -1;
 	ctx->num_works = 0;
 	ctx->works = NULL;
 
 	return;
 }
 
-static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
-				      itedtv_bus_stream_handler_t stream_handler,
-				      void *context)
+static int _itedtv_usb_start_streaming(struct itedtv_bus *bus,
+				       itedtv_bus_stream_handler_t stream_handler,
+				       itedtv_bus_stream_buffer_handler_t buffer_handler,
+				       void *context)
 {
 	int ret = 0;
 	u32 i, buf_size, num;
@@ -405,11 +625,19 @@ static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
 	mutex_lock(&ctx->lock);
 
 	ctx->stream_handler = stream_handler;
+	ctx->buffer_handler = buffer_handler;
 	ctx->ctx = context;
 
 	buf_size = bus->usb.streaming.urb_buffer_size;
 	num = bus->usb.streaming.urb_num;
 	ctx->no_dma = bus->usb.streaming.no_dma;
+	ctx->handler_mode = bus->usb.streaming.handler_mode;
+	ctx->cpu = bus->usb.streaming.handler_cpu;
+
+#ifdef __linux__
+	if (ctx->cpu >= 0 && !cpu_online(ctx->cpu))
+		ctx->cpu = -1;
+#endif
 
 	if (ctx->works && num != ctx->num_works) {
 		itedtv_usb_free_urb_buffers(ctx, true);
@@ -432,14 +660,10 @@ static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
 	if (ret)
 		goto fail;
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	if (!ctx->wq) {
-		ctx->wq = create_singlethread_workqueue("itedtv_usb_workqueue");
-		if (!ctx->wq) {
-			ret = -ENOMEM;
-			goto fail;
-		}
-	}
+#ifdef __linux__
+	ret = itedtv_usb_start_handler(ctx);
+	if (ret)
+		goto fail;
 #endif
 
 	usb_reset_endpoint(bus->usb.dev, 0x84);
@@ -449,16 +673,16 @@ static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
 	works = ctx->works;
 
 	for (i = 0; i < num; i++) {
+		itedtv_usb_prepare_urb_buffer(&works[i]);
+
 		ret = usb_submit_urb(works[i].urb, GFP_KERNEL);
 		if (ret) {
-			u32 j;
-
 			dev_err(bus->dev,
 				"itedtv_usb_start_streaming: usb_submit_urb() failed. (i: %u, ret: %d)\n",
 				i, ret);
 
-			for (j = 0; j < i; j++)
-				usb_kill_urb(works[i].urb);
+			atomic_xchg(&ctx->streaming, 0);
+			itedtv_usb_kill_urbs(ctx, i);
 
 			break;
 		}
@@ -476,11 +700,6 @@ static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
 fail:
 	atomic_xchg(&ctx->streaming, 0);
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	if (ctx->wq)
-		flush_workqueue(ctx->wq);
-#endif
-
 	itedtv_usb_clean_context(ctx);
 
 	mutex_unlock(&ctx->lock);
@@ -488,9 +707,27 @@ fail:
 	return ret;
 }
 
+static int itedtv_usb_start_streaming(struct itedtv_bus *bus,
+				      itedtv_bus_stream_handler_t stream_handler,
+				      void *context)
+{
+	return _itedtv_usb_start_streaming(bus, stream_handler, NULL, context);
+}
+
+static int itedtv_usb_start_streaming_direct(struct itedtv_bus *bus,
+					     itedtv_bus_stream_handler_t stream_handler,
+					     itedtv_bus_stream_buffer_handler_t buffer_handler,
+					     void *context)
+{
+	if (!buffer_handler)
+		return -EINVAL;
+
+	return _itedtv_usb_start_streaming(bus, stream_handler,
+					   buffer_handler, context);
+}
+
 static int itedtv_usb_stop_streaming(struct itedtv_bus *bus)
 {
-	u32 i;
 	struct itedtv_usb_context *ctx = bus->usb.priv;
 
 	dev_dbg(bus->dev, "itedtv_usb_stop_streaming\n");
@@ -499,19 +736,7 @@ static int itedtv_usb_stop_streaming(struct itedtv_bus *bus)
 
 	atomic_xchg(&ctx->streaming, 0);
 
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
-	if (ctx->wq)
-		flush_workqueue(ctx->wq);
-#endif
-
-	if (ctx->works) {
-		u32 num = ctx->num_urb;
-		struct itedtv_usb_work *works = ctx->works;
-
-		for (i = 0; i < num; i++)
-			usb_kill_urb(works[i].urb);
-	}
-
+	itedtv_usb_kill_urbs(ctx, ctx->num_urb);
 	itedtv_usb_clean_context(ctx);
 
 	mutex_unlock(&ctx->lock);
@@ -552,11 +777,18 @@ int itedtv_bus_init(struct itedtv_bus *bus)
 		mutex_init(&ctx->lock);
 		ctx->bus = bus;
 		ctx->stream_handler = NULL;
+		ctx->buffer_handler = NULL;
 		ctx->ctx = NULL;
 		ctx->num_urb = 0;
 		ctx->no_dma = false;
-#ifdef ITEDTV_BUS_USE_WORKQUEUE
+		ctx->handler_mode = ITEDTV_USB_HANDLER_COMPLETION;
+		ctx->cpu = -1;
+#ifdef __linux__
 		ctx->wq = NULL;
+		ctx->thread = NULL;
+		spin_lock_init(&ctx->thread_lock);
+		init_waitqueue_head(&ctx->thread_wait);
+		INIT_LIST_HEAD(&ctx->thread_list);
 #endif
 		ctx->num_works = 0;
 		ctx->works = NULL;
@@ -572,6 +804,7 @@ int itedtv_bus_init(struct itedtv_bus *bus)
 		bus->ops.ctrl_rx = itedtv_usb_ctrl_rx;
 		bus->ops.stream_rx = itedtv_usb_stream_rx;
 		bus->ops.start_streaming = itedtv_usb_start_streaming;
+		bus->ops.start_streaming_direct = itedtv_usb_start_streaming_direct;
 		bus->ops.stop_streaming = itedtv_usb_stop_streaming;
 
 		break;
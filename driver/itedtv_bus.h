@@ -21,7 +21,14 @@ enum itedtv_bus_type {
 	ITEDTV_BUS_USB,
 };
 
+enum itedtv_usb_handler_mode {
+	ITEDTV_USB_HANDLER_COMPLETION = 0,	// URB completion context
+	ITEDTV_USB_HANDLER_WORKQUEUE,		// per-device workqueue (Linux only)
+	ITEDTV_USB_HANDLER_THREAD,		// per-device kernel thread (Linux only)
+};
+
 typedef int (*itedtv_bus_stream_handler_t)(void *context, void *buf, u32 len);
+typedef void *(*itedtv_bus_stream_buffer_handler_t)(void *context, u32 len);
 
 struct itedtv_bus;
 
@@ -34,6 +41,10 @@ struct itedtv_bus_operations {
 	int (*start_streaming)(struct itedtv_bus *bus,
 			       itedtv_bus_stream_handler_t stream_handler,
 			       void *context);
+	int (*start_streaming_direct)(struct itedtv_bus *bus,
+				      itedtv_bus_stream_handler_t stream_handler,
+				      itedtv_bus_stream_buffer_handler_t buffer_handler,
+				      void *context);
 	int (*stop_streaming)(struct itedtv_bus *bus);
 };
 
@@ -44,11 +55,14 @@ struct itedtv_bus {
 		struct {
 			struct usb_device *dev;
 			int ctrl_timeout;
+			int ctrl_delay;	// us, delay after each control transfer (for Linux)
 			int max_bulk_size;
 			struct {
 				u32 urb_buffer_size;
 				u32 urb_num;
 				bool no_dma;	// for Linux
+				enum itedtv_usb_handler_mode handler_mode;	// for Linux
+				int handler_cpu;	// for Linux, -1: any
 				bool no_raw_io;	// for Windows(WinUSB)
 			} streaming;
 			void *priv;
@@ -104,6 +118,18 @@ static inline int itedtv_bus_start_streaming(struct itedtv_bus *bus,
 	return bus->ops.start_streaming(bus, stream_handler, context);
 }
 
+static inline int itedtv_bus_start_streaming_direct(struct itedtv_bus *bus,
+						    itedtv_bus_stream_handler_t stream_handler,
+						    itedtv_bus_stream_buffer_handler_t buffer_handler,
+						    void *context)
+{
+	if (!bus || !bus->ops.start_streaming_direct)
+		return -EINVAL;
+
+	return bus->ops.start_streaming_direct(bus, stream_handler,
+					       buffer_handler, context);
+}
+
 static inline int itedtv_bus_stop_streaming(struct itedtv_bus *bus)
 {
 	if (!bus || !bus->ops.stop_streaming)
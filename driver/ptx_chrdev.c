@@ -8,12 +8,20 @@
 #include "print_format.h"
 #include "ptx_chrdev.h"
 
+#include <linux/version.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
 #include <linux/sched.h>
 #include <linux/uaccess.h>
+#include <linux/compat.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+
+#include "ptx_lock_wait.h"
 
 static LIST_HEAD(ctx_list);
 static DEFINE_MUTEX(ctx_list_lock);
@@ -85,12 +93,24 @@ static int ptx_chrdev_open(struct inode *inode, struct file *file)
 	mutex_unlock(&group->lock);
 
 	chrdev->current_system = PTX_UNSPECIFIED_SYSTEM;
+	chrdev->current_freq = 0;
+	chrdev->read_mode = PTXT_READ_FULL;
+	WRITE_ONCE(chrdev->stream_ended, false);
+	WRITE_ONCE(chrdev->ringbuf_threshold_size,
+		   chrdev->ringbuf_default_threshold_size);
+	WRITE_ONCE(chrdev->wakeup_latency, 0);
+	atomic_set(&chrdev->tune_state, PTXT_TUNE_IDLE);
 
 	if (chrdev->ops && chrdev->ops->open)
 		ret = chrdev->ops->open(chrdev);
 
-	if (!ret)
+	if (!ret) {
 		file->private_data = chrdev;
+#ifdef FMODE_NOWAIT
+		/* read_iter honors IOCB_NOWAIT */
+		file->f_mode |= FMODE_NOWAIT;
+#endif
+	}
 
 	mutex_unlock(&chrdev->lock);
 
@@ -115,6 +135,26 @@ fail:
 	return ret;
 }
 
+/* returns 0 once data is readable or the ring buffer has stopped */
+static int ptx_chrdev_wait_readable(struct ptx_chrdev *chrdev, bool nonblock)
+{
+	struct ptx_chrdev_group *group = chrdev->parent;
+
+	if (ringbuffer_is_readable(chrdev->ringbuf))
+		return 0;
+
+	if (nonblock)
+		return (ringbuffer_is_running(chrdev->ringbuf)) ? -EAGAIN : 0;
+
+	if (wait_event_interruptible(chrdev->ringbuf_wait,
+				     likely(ringbuffer_is_readable(chrdev->ringbuf)) ||
+				     unlikely(!ringbuffer_is_running(chrdev->ringbuf)) ||
+				     unlikely(!atomic_read(&group->available))))
+		return -EINTR;
+
+	return 0;
+}
+
 static ssize_t ptx_chrdev_read(struct file *file,
 			       char __user *buf, size_t count, loff_t *ppos)
 {
@@ -132,12 +172,16 @@ static ssize_t ptx_chrdev_read(struct file *file,
 	while (likely(remain)) {
 		size_t len;
 
-		if (wait_event_interruptible(chrdev->ringbuf_wait,
-					     likely(ringbuffer_is_readable(chrdev->ringbuf)) ||
-					     unlikely(!ringbuffer_is_running(chrdev->ringbuf)) ||
-					     unlikely(!atomic_read(&group->available)))) {
-			if (unlikely(remain == count))
-				ret = -EINTR;
+		if (remain != count &&
+		    chrdev->read_mode == PTXT_READ_AVAILABLE &&
+		    !ringbuffer_is_readable(chrdev->ringbuf))
+			break;
+
+		ret = ptx_chrdev_wait_readable(chrdev,
+					       !!(file->f_flags & O_NONBLOCK));
+		if (unlikely(ret)) {
+			if (remain != count)
+				ret = 0;
 
 			break;
 		}
@@ -154,6 +198,331 @@ static ssize_t ptx_chrdev_read(struct file *file,
 	return likely(!ret) ? (count - remain) : ret;
 }
 
+static ssize_t ptx_chrdev_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	int ret = 0;
+	struct file *file = iocb->ki_filp;
+	struct ptx_chrdev *chrdev = file->private_data;
+	struct ptx_chrdev_group *group = chrdev->parent;
+	size_t count = iov_iter_count(to), remain = count;
+	bool nowait = !!(iocb->ki_flags & IOCB_NOWAIT);
+	bool nonblock = nowait || (file->f_flags & O_NONBLOCK);
+
+	if (unlikely(!atomic_read_acquire(&group->available)))
+		return -EIO;
+
+	ringbuffer_ready_read(chrdev->ringbuf);
+
+	while (likely(remain)) {
+		size_t len;
+
+		if (remain != count &&
+		    chrdev->read_mode == PTXT_READ_AVAILABLE &&
+		    !ringbuffer_is_readable(chrdev->ringbuf))
+			break;
+
+		ret = ptx_chrdev_wait_readable(chrdev, nonblock);
+		if (unlikely(ret)) {
+			if (remain != count)
+				ret = 0;
+
+			break;
+		}
+
+		len = remain;
+		ret = ringbuffer_read_iter(chrdev->ringbuf, to, &len, nowait);
+		if (unlikely(ret == -EAGAIN && remain != count))
+			ret = 0;
+
+		if (unlikely(ret || !len))
+			break;
+
+		remain -= len;
+	}
+
+	return likely(!ret) ? (count - remain) : ret;
+}
+
+static const struct pipe_buf_operations ptx_chrdev_pipe_buf_ops = {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 1, 0)
+	.can_merge = 0,
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+	.confirm = generic_pipe_buf_confirm,
+	.steal = generic_pipe_buf_steal,
+#endif
+	.release = generic_pipe_buf_release,
+	.get = generic_pipe_buf_get
+};
+
+static void ptx_chrdev_spd_release(struct splice_pipe_desc *spd,
+				   unsigned int i)
+{
+	put_page(spd->pages[i]);
+}
+
+static unsigned int ptx_chrdev_pipe_space(struct pipe_inode_info *pipe)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	return pipe->max_usage - pipe_occupancy(pipe->head, pipe->tail);
+#else
+	return pipe->buffers - pipe->nrbufs;
+#endif
+}
+
+/*
+ * The data is copied into newly allocated pages. Lending ring buffer pages
+ * to the pipe is not safe because the writer reuses them as soon as head
+ * has moved past them.
+ */
+static ssize_t ptx_chrdev_splice_read(struct file *file, loff_t *ppos,
+				      struct pipe_inode_info *pipe,
+				      size_t len, unsigned int flags)
+{
+	ssize_t ret = 0;
+	struct ptx_chrdev *chrdev = file->private_data;
+	struct ptx_chrdev_group *group = chrdev->parent;
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages = 0,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.ops = &ptx_chrdev_pipe_buf_ops,
+		.spd_release = ptx_chrdev_spd_release,
+	};
+	unsigned int num;
+
+	if (unlikely(!atomic_read_acquire(&group->available)))
+		return -EIO;
+
+	ringbuffer_ready_read(chrdev->ringbuf);
+
+	ret = ptx_chrdev_wait_readable(chrdev,
+				       (file->f_flags & O_NONBLOCK) ||
+				       (flags & SPLICE_F_NONBLOCK));
+	if (ret)
+		return ret;
+
+	/* never take more out of the ring buffer than the pipe can hold */
+	num = min_t(unsigned int, ptx_chrdev_pipe_space(pipe),
+		    PIPE_DEF_BUFFERS);
+	if (!num)
+		return -EAGAIN;
+
+	len = min_t(size_t, len, ringbuffer_get_readable_size(chrdev->ringbuf));
+
+	while (len && spd.nr_pages < num) {
+		struct page *page;
+		size_t l = min_t(size_t, len, PAGE_SIZE);
+
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = ringbuffer_read(chrdev->ringbuf, page_address(page), &l);
+		if (ret || !l) {
+			put_page(page);
+			break;
+		}
+
+		pages[spd.nr_pages] = page;
+		partial[spd.nr_pages].offset = 0;
+		partial[spd.nr_pages].len = l;
+		partial[spd.nr_pages].private = 0;
+		spd.nr_pages++;
+
+		len -= l;
+	}
+
+	if (spd.nr_pages)
+		ret = splice_to_pipe(pipe, &spd);
+
+	return ret;
+}
+
+static __poll_t ptx_chrdev_poll(struct file *file,
+				struct poll_table_struct *wait)
+{
+	__poll_t mask = 0;
+	struct ptx_chrdev *chrdev = file->private_data;
+	struct ptx_chrdev_group *group = chrdev->parent;
+
+	poll_wait(file, &chrdev->ringbuf_wait, wait);
+
+	if (unlikely(!atomic_read_acquire(&group->available)))
+		return EPOLLERR | EPOLLHUP;
+
+	ringbuffer_ready_read(chrdev->ringbuf);
+
+	/* never hang up before the first start, tuning happens in that window */
+	if (ringbuffer_is_readable(chrdev->ringbuf))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	else if (READ_ONCE(chrdev->stream_ended) &&
+		 !ringbuffer_is_running(chrdev->ringbuf))
+		mask |= EPOLLHUP;
+
+	if (atomic_read_acquire(&chrdev->tune_state) == PTXT_TUNE_DONE)
+		mask |= EPOLLPRI;
+
+	return mask;
+}
+
+static int ptx_chrdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ptx_chrdev *chrdev = file->private_data;
+	struct ptx_chrdev_group *group = chrdev->parent;
+
+	BUILD_BUG_ON(sizeof(struct ptxt_ringbuf_ctrl) != sizeof(struct ringbuffer_ctrl));
+	BUILD_BUG_ON(offsetof(struct ptxt_ringbuf_ctrl, head) != offsetof(struct ringbuffer_ctrl, head));
+	BUILD_BUG_ON(offsetof(struct ptxt_ringbuf_ctrl, tail) != offsetof(struct ringbuffer_ctrl, tail));
+	BUILD_BUG_ON(offsetof(struct ptxt_ringbuf_ctrl, actual_size) != offsetof(struct ringbuffer_ctrl, actual_size));
+
+	if (unlikely(!atomic_read_acquire(&group->available)))
+		return -EIO;
+
+	return ringbuffer_mmap(chrdev->ringbuf, vma);
+}
+
+static enum hrtimer_restart ptx_chrdev_wakeup_timer(struct hrtimer *timer)
+{
+	struct ptx_chrdev *chrdev = container_of(timer,
+						 struct ptx_chrdev,
+						 wakeup_timer);
+
+	atomic_set(&chrdev->wakeup_timer_armed, 0);
+	wake_up(&chrdev->ringbuf_wait);
+
+	return HRTIMER_NORESTART;
+}
+
+static void ptx_chrdev_cancel_wakeup_timer(struct ptx_chrdev *chrdev)
+{
+	hrtimer_cancel(&chrdev->wakeup_timer);
+	atomic_set(&chrdev->wakeup_timer_armed, 0);
+
+	return;
+}
+
+/* the default threshold scaled to the current ring buffer size */
+static size_t ptx_chrdev_default_threshold_size(struct ptx_chrdev *chrdev)
+{
+	size_t size = chrdev->ringbuf->size;
+
+	if (size == chrdev->ringbuf_default_size)
+		return chrdev->ringbuf_default_threshold_size;
+
+	return max_t(size_t, mult_frac(size,
+				       chrdev->ringbuf_default_threshold_size,
+				       chrdev->ringbuf_default_size), 188);
+}
+
+static int ptx_chrdev_set_ringbuf_size(struct ptx_chrdev *chrdev,
+				       size_t size)
+{
+	int ret = 0;
+
+	if (!size || size % 188 || size > chrdev->ringbuf_max_size)
+		return -EINVAL;
+
+	if (chrdev->streaming)
+		return -EBUSY;
+
+	ret = ringbuffer_alloc(chrdev->ringbuf, size);
+	if (ret) {
+		dev_err(chrdev->parent->dev,
+			"ptx_chrdev_set_ringbuf_size %u:%u: ringbuffer_alloc(%zu) failed. (ret: %d)\n",
+			chrdev->parent->id, chrdev->id, size, ret);
+		return ret;
+	}
+
+	WRITE_ONCE(chrdev->ringbuf_threshold_size,
+		   ptx_chrdev_default_threshold_size(chrdev));
+
+	return 0;
+}
+
+static int ptx_chrdev_set_pid_filter(struct ptx_chrdev *chrdev,
+				     const void __user *arg)
+{
+	struct ptx_chrdev_pid_filter *filter, *old;
+
+	filter = kmalloc(sizeof(*filter), GFP_KERNEL);
+	if (!filter)
+		return -ENOMEM;
+
+	if (copy_from_user(filter->bitmap, arg, sizeof(filter->bitmap))) {
+		kfree(filter);
+		return -EFAULT;
+	}
+
+	old = rcu_dereference_protected(chrdev->pid_filter,
+					lockdep_is_held(&chrdev->lock));
+	rcu_assign_pointer(chrdev->pid_filter, filter);
+
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+static void ptx_chrdev_clear_pid_filter(struct ptx_chrdev *chrdev)
+{
+	struct ptx_chrdev_pid_filter *old;
+
+	old = rcu_dereference_protected(chrdev->pid_filter,
+					lockdep_is_held(&chrdev->lock));
+	RCU_INIT_POINTER(chrdev->pid_filter, NULL);
+
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return;
+}
+
+static int ptx_chrdev_set_hw_pid_filter(struct ptx_chrdev *chrdev,
+					const void __user *arg)
+{
+	int ret = 0;
+	struct ptxt_hw_pid_filter hw_filter;
+	struct ptx_pid_filter filter;
+	unsigned int i;
+
+	if (!chrdev->ops || !chrdev->ops->set_pid_filter)
+		return -ENOSYS;
+
+	if (copy_from_user(&hw_filter, arg, sizeof(hw_filter)))
+		return -EFAULT;
+
+	if (hw_filter.num > PTXT_HW_PID_FILTER_MAX)
+		return -EINVAL;
+
+	filter.block = !!hw_filter.block;
+	filter.num = hw_filter.num;
+
+	for (i = 0; i < filter.num; i++) {
+		if (hw_filter.pid[i] >= PTXT_PID_NUM)
+			return -EINVAL;
+
+		filter.pid[i] = hw_filter.pid[i];
+	}
+
+	ret = chrdev->ops->set_pid_filter(chrdev, (filter.num) ? &filter : NULL);
+	if (ret) {
+		dev_err(chrdev->parent->dev,
+			"ptx_chrdev_set_hw_pid_filter %u:%u: chrdev->ops->set_pid_filter() failed. (ret: %d)\n",
+			chrdev->parent->id, chrdev->id, ret);
+		return ret;
+	}
+
+	chrdev->hw_pid_filter = !!filter.num;
+
+	return 0;
+}
+
 static int ptx_chrdev_release(struct inode *inode, struct file *file)
 {
 	int ret = 0;
@@ -163,30 +532,601 @@ static int ptx_chrdev_release(struct inode *inode, struct file *file)
 	struct kref *owner_kref = group->owner_kref;
 	void (*owner_kref_release)(struct kref *) = group->owner_kref_release;
 
-	mutex_lock(&chrdev->lock);
+	/* wait for the asynchronous tune, it takes chrdev->lock */
+	flush_work(&chrdev->tune_work);
+
+	mutex_lock(&chrdev->lock);
+
+	if (chrdev->streaming) {
+		if (chrdev->ops && chrdev->ops->set_capture)
+			chrdev->ops->set_capture(chrdev, false);
+
+		ringbuffer_stop(chrdev->ringbuf);
+		ptx_chrdev_cancel_wakeup_timer(chrdev);
+		wake_up(&chrdev->ringbuf_wait);
+		chrdev->streaming = false;
+	}
+
+	if (chrdev->ops && chrdev->ops->release)
+		ret = chrdev->ops->release(chrdev);
+
+	if (chrdev->ringbuf->size != chrdev->ringbuf_default_size)
+		ptx_chrdev_set_ringbuf_size(chrdev, chrdev->ringbuf_default_size);
+
+	ptx_chrdev_clear_pid_filter(chrdev);
+
+	if (chrdev->hw_pid_filter) {
+		chrdev->ops->set_pid_filter(chrdev, NULL);
+		chrdev->hw_pid_filter = false;
+	}
+
+	mutex_unlock(&chrdev->lock);
+
+	atomic_dec_return(&chrdev->open);
+	kref_put(&group->kref, ptx_chrdev_group_release);
+
+	if (owner_kref)
+		kref_put(owner_kref, owner_kref_release);
+
+	kref_put(&ctx->kref, ptx_chrdev_context_release);
+	return ret;
+}
+
+static int ptx_chrdev_consume_ringbuf(struct ptx_chrdev *chrdev,
+				      struct file *file, void __user *arg)
+{
+	int ret = 0;
+	struct ptx_chrdev_group *group = chrdev->parent;
+	struct ptxt_consume consume;
+	size_t len;
+
+	if (copy_from_user(&consume, arg, sizeof(consume)))
+		return -EFAULT;
+
+	ringbuffer_ready_read(chrdev->ringbuf);
+
+	len = consume.len;
+	ringbuffer_consume(chrdev->ringbuf, &len);
+	consume.len = len;
+
+	if (!(file->f_flags & O_NONBLOCK) &&
+	    wait_event_interruptible(chrdev->ringbuf_wait,
+				     ringbuffer_is_readable(chrdev->ringbuf) ||
+				     !ringbuffer_is_running(chrdev->ringbuf) ||
+				     !atomic_read(&group->available)))
+		ret = -EINTR;
+
+	consume.available = ringbuffer_get_readable_size(chrdev->ringbuf);
+
+	if (copy_to_user(arg, &consume, sizeof(consume)))
+		return -EFAULT;
+
+	return ret;
+}
+
+static int ptx_chrdev_set_drop_policy(struct ptx_chrdev *chrdev,
+				      unsigned long arg)
+{
+	enum ptxt_drop_policy policy;
+
+	/* check the whole argument, the enum would truncate it */
+	switch (arg) {
+	case PTXT_DROP_NEWEST:
+	case PTXT_DROP_OLDEST:
+		policy = arg;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	chrdev->drop_policy = policy;
+	ringbuffer_set_drop_policy(chrdev->ringbuf,
+				   (policy == PTXT_DROP_OLDEST), 188);
+
+	return 0;
+}
+
+static int ptx_chrdev_get_drop_stats(struct ptx_chrdev *chrdev,
+				     void __user *arg)
+{
+	struct ptxt_drop_stats stats;
+
+	stats.bytes = atomic64_read(&chrdev->dropped_bytes);
+	stats.packets = atomic64_read(&chrdev->dropped_packets);
+
+	if (copy_to_user(arg, &stats, sizeof(stats)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ptx_chrdev_tune(struct ptx_chrdev *chrdev,
+			   struct ptx_tune_params *params)
+{
+	int ret = 0;
+
+	if (!chrdev->ops || !chrdev->ops->tune)
+		return -ENOSYS;
+
+	/* same transponder: only the slot has to be switched while locked */
+	if (params->system == PTX_ISDB_S_SYSTEM &&
+	    chrdev->current_system == PTX_ISDB_S_SYSTEM &&
+	    chrdev->current_freq == params->freq &&
+	    chrdev->ops->check_lock && chrdev->ops->set_stream_id) {
+		bool locked = false;
+
+		ret = chrdev->ops->check_lock(chrdev, &locked);
+		if (!ret && locked)
+			return chrdev->ops->set_stream_id(chrdev,
+							  params->stream_id);
+	}
+
+	if (params->system == PTX_ISDB_S_SYSTEM &&
+	    (chrdev->options & PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE) &&
+	    chrdev->ops->set_stream_id) {
+		ret = chrdev->ops->set_stream_id(chrdev, params->stream_id);
+		if (ret)
+			return ret;
+	}
+
+	chrdev->current_freq = 0;
+
+	ret = chrdev->ops->tune(chrdev, params);
+	if (ret)
+		return ret;
+
+	chrdev->current_system = params->system;
+	chrdev->current_freq = params->freq;
+
+	if (chrdev->ops->check_lock) {
+		struct ptx_lock_wait wait;
+		bool locked = false;
+		unsigned int elapsed;
+
+		ptx_lock_wait_start(&wait, 3000);
+		do {
+			ret = chrdev->ops->check_lock(chrdev, &locked);
+			if ((!ret && locked) || ret == -ECANCELED)
+				break;
+		} while (ptx_lock_wait_next(&wait));
+
+		ptx_lock_wait_record(&wait, chrdev->current_system,
+				     PTX_LOCK_STAGE_DEMOD, !ret && locked);
+
+		if (ret != -ECANCELED && !locked)
+			ret = -EAGAIN;
+
+		if (ret)
+			return ret;
+
+		/* TC90522 (ISDB-T) needs at least 340ms after tuning */
+		elapsed = ptx_lock_wait_elapsed(&wait);
+		if (chrdev->current_system == PTX_ISDB_T_SYSTEM &&
+		    (chrdev->options & PTX_CHRDEV_WAIT_AFTER_LOCK_TC_T) &&
+		    elapsed < 340)
+			msleep(340 - elapsed);
+	}
+
+	if (chrdev->current_system == PTX_ISDB_S_SYSTEM &&
+	    !(chrdev->options & PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE) &&
+	    chrdev->ops->set_stream_id)
+		ret = chrdev->ops->set_stream_id(chrdev, params->stream_id);
+
+	if (chrdev->options & PTX_CHRDEV_WAIT_AFTER_LOCK)
+		msleep(200);
+
+	return ret;
+}
+
+static int ptx_chrdev_set_capture(struct ptx_chrdev *chrdev, bool status)
+{
+	int ret = 0;
+
+	if (chrdev->streaming == status)
+		return -EALREADY;
+
+	if (!chrdev->ops || !chrdev->ops->set_capture)
+		return -ENOSYS;
+
+	if (status) {
+		chrdev->ringbuf_write_size = 0;
+
+		ret = chrdev->ops->set_capture(chrdev, true);
+		if (ret)
+			return ret;
+
+		ringbuffer_reset(chrdev->ringbuf);
+		ringbuffer_start(chrdev->ringbuf);
+		WRITE_ONCE(chrdev->stream_ended, false);
+		chrdev->streaming = true;
+	} else {
+		ret = chrdev->ops->set_capture(chrdev, false);
+		if (ret)
+			return ret;
+
+		ringbuffer_stop(chrdev->ringbuf);
+		ptx_chrdev_cancel_wakeup_timer(chrdev);
+		WRITE_ONCE(chrdev->stream_ended, true);
+		wake_up(&chrdev->ringbuf_wait);
+		chrdev->streaming = false;
+	}
+
+	return 0;
+}
+
+static void ptx_chrdev_tune_work(struct work_struct *work)
+{
+	struct ptx_chrdev *chrdev = container_of(work,
+						 struct ptx_chrdev, tune_work);
+	int ret = 0;
+
+	mutex_lock(&chrdev->lock);
+
+	if (atomic_read_acquire(&chrdev->parent->available))
+		ret = ptx_chrdev_tune(chrdev, &chrdev->tune_params);
+	else
+		ret = -EIO;
+
+	chrdev->tune_result = ret;
+	atomic_set_release(&chrdev->tune_state, PTXT_TUNE_DONE);
+
+	mutex_unlock(&chrdev->lock);
+
+	wake_up(&chrdev->ringbuf_wait);
+}
+
+/* called without chrdev->lock, never sleeps */
+static int ptx_chrdev_tune_async(struct ptx_chrdev *chrdev)
+{
+	int ret = 0, state;
+
+	if (!chrdev->ops || !chrdev->ops->tune)
+		return -ENOSYS;
+
+	state = atomic_read(&chrdev->tune_state);
+	if (state == PTXT_TUNE_BUSY ||
+	    atomic_cmpxchg(&chrdev->tune_state, state, PTXT_TUNE_BUSY) != state)
+		return -EBUSY;
+
+	/* another ioctl, such as a synchronous tune, is in progress */
+	if (!mutex_trylock(&chrdev->lock)) {
+		atomic_set(&chrdev->tune_state, state);
+		return -EBUSY;
+	}
+
+	if (chrdev->params.system == PTX_UNSPECIFIED_SYSTEM ||
+	    !chrdev->params.freq) {
+		ret = -EINVAL;
+		atomic_set(&chrdev->tune_state, state);
+	} else {
+		memcpy(&chrdev->tune_params, &chrdev->params,
+		       sizeof(chrdev->tune_params));
+		chrdev->tune_result = 0;
+	}
+
+	mutex_unlock(&chrdev->lock);
+
+	if (ret)
+		return ret;
+
+	/* unbound, so that several tuners can wait for lock in parallel */
+	queue_work(system_unbound_wq, &chrdev->tune_work);
+
+	return 0;
+}
+
+static int ptx_chrdev_get_tune_status(struct ptx_chrdev *chrdev,
+				      void __user *arg)
+{
+	struct ptxt_tune_status status;
+
+	status.state = atomic_read_acquire(&chrdev->tune_state);
+	status.result = (status.state == PTXT_TUNE_DONE) ? chrdev->tune_result
+							 : 0;
+
+	if (copy_to_user(arg, &status, sizeof(status)))
+		return -EFAULT;
+
+	/* the result has been delivered */
+	if (status.state == PTXT_TUNE_DONE)
+		atomic_cmpxchg(&chrdev->tune_state,
+			       PTXT_TUNE_DONE, PTXT_TUNE_IDLE);
+
+	return 0;
+}
+
+static int ptx_chrdev_set_lnb_voltage(struct ptx_chrdev *chrdev, int voltage)
+{
+	switch (voltage) {
+	case 0:
+	case 11:
+	case 15:
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	if (!chrdev->ops || !chrdev->ops->set_lnb_voltage)
+		return (voltage) ? -ENOSYS : 0;
+
+	return chrdev->ops->set_lnb_voltage(chrdev, voltage);
+}
+
+static int ptx_chrdev_get_info(struct ptx_chrdev *chrdev, void __user *arg)
+{
+	struct ptxt_info info;
+
+	memset(&info, 0, sizeof(info));
+
+	strscpy(info.name, chrdev->name, sizeof(info.name));
+	info.cap.systems = chrdev->system_cap;
+	info.cap.streams = PTX_MPEG_TRANSPORT_STREAM;
+
+	if (copy_to_user(arg, &info, sizeof(info)))
+		return -EFAULT;
+
+	return 0;
+}
+
+#ifdef CONFIG_COMPAT
+/* the structures which embed a pointer, as seen by 32-bit processes */
+struct ptxt_params32 {
+	enum ptx_system_type system;
+	__u32 freq;
+	__u32 num_prop;
+	compat_uptr_t prop;
+};
+
+struct ptxt_stats32 {
+	__u32 num_stat;
+	compat_uptr_t stat;
+};
+
+/* the ioctls whose number is encoded with the size of a pointer */
+#define PTX_GET_CNR32		_IOR(0x8d, 0x04, compat_uptr_t)
+#define PTXT_GET_INFO32		_IOR(0xe7, 0x00, compat_uptr_t)
+#define PTXT_GET_PARAMS32	_IOR(0xe7, 0x01, compat_uptr_t)
+#define PTXT_SET_PARAMS32	_IOW(0xe7, 0x02, compat_uptr_t)
+#define PTXT_READ_STATS32	_IOR(0xe7, 0x07, compat_uptr_t)
+#endif
+
+static int ptx_chrdev_copy_params_from_user(struct ptxt_params *params,
+					    const void __user *arg)
+{
+#ifdef CONFIG_COMPAT
+	if (in_compat_syscall()) {
+		struct ptxt_params32 params32;
+
+		if (copy_from_user(&params32, arg, sizeof(params32)))
+			return -EFAULT;
+
+		params->system = params32.system;
+		params->freq = params32.freq;
+		params->num_prop = params32.num_prop;
+		params->prop = compat_ptr(params32.prop);
+
+		return 0;
+	}
+#endif
+
+	if (copy_from_user(params, arg, sizeof(*params)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ptx_chrdev_copy_params_to_user(void __user *arg,
+					  const struct ptxt_params *params)
+{
+#ifdef CONFIG_COMPAT
+	if (in_compat_syscall()) {
+		struct ptxt_params32 params32;
+
+		params32.system = params->system;
+		params32.freq = params->freq;
+		params32.num_prop = params->num_prop;
+		params32.prop = ptr_to_compat(params->prop);
+
+		if (copy_to_user(arg, &params32, sizeof(params32)))
+			return -EFAULT;
+
+		return 0;
+	}
+#endif
+
+	if (copy_to_user(arg, params, sizeof(*params)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ptx_chrdev_copy_stats_from_user(struct ptxt_stats *stats,
+					   const void __user *arg)
+{
+#ifdef CONFIG_COMPAT
+	if (in_compat_syscall()) {
+		struct ptxt_stats32 stats32;
+
+		if (copy_from_user(&stats32, arg, sizeof(stats32)))
+			return -EFAULT;
+
+		stats->num_stat = stats32.num_stat;
+		stats->stat = compat_ptr(stats32.stat);
+
+		return 0;
+	}
+#endif
+
+	if (copy_from_user(stats, arg, sizeof(*stats)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ptx_chrdev_get_params(struct ptx_chrdev *chrdev, void __user *arg)
+{
+	struct ptxt_params params;
+	struct ptxt_additional_param prop;
+	u32 i;
+
+	if (ptx_chrdev_copy_params_from_user(&params, arg))
+		return -EFAULT;
+
+	params.system = chrdev->params.system;
+
+	/* ISDB-T: Hz, ISDB-S: kHz */
+	if (params.system == PTX_ISDB_T_SYSTEM)
+		params.freq = chrdev->params.freq * 1000;
+	else
+		params.freq = chrdev->params.freq;
+
+	for (i = 0; i < params.num_prop; i++) {
+		if (copy_from_user(&prop, &params.prop[i], sizeof(prop)))
+			return -EFAULT;
+
+		switch (prop.prop) {
+		case PTXT_BANDWIDTH_PARAM:
+			prop.data = chrdev->params.bandwidth;
+			break;
+
+		case PTXT_STREAM_ID_PARAM:
+			prop.data = chrdev->params.stream_id;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+
+		if (copy_to_user(&params.prop[i], &prop, sizeof(prop)))
+			return -EFAULT;
+	}
+
+	if (ptx_chrdev_copy_params_to_user(arg, &params))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ptx_chrdev_set_params(struct ptx_chrdev *chrdev,
+				 const void __user *arg)
+{
+	struct ptxt_params params;
+	struct ptxt_additional_param prop;
+	struct ptx_tune_params tune_params;
+	u32 i;
+
+	if (ptx_chrdev_copy_params_from_user(&params, arg))
+		return -EFAULT;
+
+	if (!(chrdev->system_cap & params.system))
+		return -EINVAL;
+
+	tune_params.system = params.system;
+
+	switch (params.system) {
+	case PTX_ISDB_T_SYSTEM:
+		/* Hz to kHz */
+		tune_params.freq = params.freq / 1000;
+		tune_params.bandwidth = 6;
+		break;
+
+	case PTX_ISDB_S_SYSTEM:
+		tune_params.freq = params.freq;
+		tune_params.bandwidth = 0;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	tune_params.stream_id = 0;
+
+	for (i = 0; i < params.num_prop; i++) {
+		if (copy_from_user(&prop, &params.prop[i], sizeof(prop)))
+			return -EFAULT;
+
+		switch (prop.prop) {
+		case PTXT_BANDWIDTH_PARAM:
+			tune_params.bandwidth = prop.data;
+			break;
+
+		case PTXT_STREAM_ID_PARAM:
+			if (prop.data > 0xffff)
+				return -EINVAL;
+
+			tune_params.stream_id = prop.data;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+	}
+
+	memcpy(&chrdev->params, &tune_params, sizeof(chrdev->params));
+
+	return 0;
+}
+
+static int ptx_chrdev_read_stats(struct ptx_chrdev *chrdev, void __user *arg)
+{
+	int ret = 0;
+	struct ptxt_stats stats;
+	struct ptxt_stat stat;
+	u32 i;
+
+	if (!chrdev->ops)
+		return -ENOSYS;
 
-	if (chrdev->streaming) {
-		if (chrdev->ops && chrdev->ops->set_capture)
-			chrdev->ops->set_capture(chrdev, false);
+	if (ptx_chrdev_copy_stats_from_user(&stats, arg))
+		return -EFAULT;
 
-		ringbuffer_stop(chrdev->ringbuf);
-		wake_up(&chrdev->ringbuf_wait);
-		chrdev->streaming = false;
-	}
+	/* a failed entry is reported in its result, the others are still read */
+	for (i = 0; i < stats.num_stat; i++) {
+		if (copy_from_user(&stat, &stats.stat[i], sizeof(stat)))
+			return -EFAULT;
 
-	if (chrdev->ops && chrdev->ops->release)
-		ret = chrdev->ops->release(chrdev);
+		stat.value = 0;
 
-	mutex_unlock(&chrdev->lock);
+		switch (stat.stat) {
+		case PTXT_SIGNAL_STRENGTH_STAT:
+			if (chrdev->ops->read_signal_strength)
+				ret = chrdev->ops->read_signal_strength(chrdev,
+									&stat.value);
+			else
+				ret = -ENOSYS;
+			break;
 
-	atomic_dec_return(&chrdev->open);
-	kref_put(&group->kref, ptx_chrdev_group_release);
+		case PTXT_CNR_STAT:
+			if (chrdev->ops->read_cnr)
+				ret = chrdev->ops->read_cnr(chrdev, &stat.value);
+			else
+				ret = -ENOSYS;
+			break;
 
-	if (owner_kref)
-		kref_put(owner_kref, owner_kref_release);
+		case PTXT_CNR_RAW_STAT:
+			if (chrdev->ops->read_cnr_raw)
+				ret = chrdev->ops->read_cnr_raw(chrdev, &stat.value);
+			else
+				ret = -ENOSYS;
+			break;
 
-	kref_put(&ctx->kref, ptx_chrdev_context_release);
-	return ret;
+		default:
+			ret = -EINVAL;
+			break;
+		}
+
+		if (ret)
+			stat.value = 0;
+
+		stat.result = ret;
+
+		if (copy_to_user(&stats.stat[i], &stat, sizeof(stat)))
+			return -EFAULT;
+	}
+
+	return 0;
 }
 
 static long ptx_chrdev_unlocked_ioctl(struct file *file,
@@ -199,8 +1139,35 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 	if (!atomic_read_acquire(&group->available))
 		return -EIO;
 
+	/* ioctls which must not wait for chrdev->lock */
+	switch (cmd) {
+	case PTXT_CONSUME_RINGBUF:
+		return ptx_chrdev_consume_ringbuf(chrdev, file, (void __user *)arg);
+
+	case PTXT_GET_DROP_STATS:
+		return ptx_chrdev_get_drop_stats(chrdev, (void __user *)arg);
+
+	case PTXT_GET_TUNE_STATUS:
+		return ptx_chrdev_get_tune_status(chrdev, (void __user *)arg);
+
+	case PTXT_TUNE_ASYNC:
+		return ptx_chrdev_tune_async(chrdev);
+
+	default:
+		break;
+	}
+
+	/* the asynchronous tune holds chrdev->lock until it has finished */
+	if (atomic_read_acquire(&chrdev->tune_state) == PTXT_TUNE_BUSY)
+		return -EBUSY;
+
 	mutex_lock(&chrdev->lock);
 
+	if (unlikely(atomic_read_acquire(&chrdev->tune_state) == PTXT_TUNE_BUSY)) {
+		mutex_unlock(&chrdev->lock);
+		return -EBUSY;
+	}
+
 	switch (cmd) {
 	case PTX_SET_CHANNEL:
 	{
@@ -212,7 +1179,7 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 			break;
 		}
 
-		if (copy_from_user(&freq, (void *)arg, sizeof(freq))) {
+		if (copy_from_user(&freq, (void __user *)arg, sizeof(freq))) {
 			ret = -EFAULT;
 			break;
 		}
@@ -316,99 +1283,17 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 		if (ret)
 			break;
 
-		if (chrdev->params.system == PTX_ISDB_S_SYSTEM &&
-		    (chrdev->options & PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE) &&
-		    chrdev->ops->set_stream_id) {
-			ret = chrdev->ops->set_stream_id(chrdev,
-							 chrdev->params.stream_id);
-			if (ret)
-				break;
-		}
-
-		ret = chrdev->ops->tune(chrdev, &chrdev->params);
-		if (ret) {
-			chrdev->params.system = system;
-			break;
-		}
-
-		chrdev->current_system = chrdev->params.system;
+		ret = ptx_chrdev_tune(chrdev, &chrdev->params);
 		chrdev->params.system = system;
-
-		if (chrdev->ops->check_lock) {
-			int i;
-			bool locked = false;
-
-			i = 300;
-			while (i--) {
-				ret = chrdev->ops->check_lock(chrdev, &locked);
-				if ((!ret && locked) || ret == -ECANCELED)
-					break;
-
-				msleep(10);
-			}
-
-			if (ret != -ECANCELED && !locked)
-				ret = -EAGAIN;
-
-			if (ret)
-				break;
-
-			if (chrdev->current_system == PTX_ISDB_T_SYSTEM &&
-			    (chrdev->options & PTX_CHRDEV_WAIT_AFTER_LOCK_TC_T) &&
-			    i > 265)
-				msleep((i - 265) * 10);
-		}
-
-		if (chrdev->current_system == PTX_ISDB_S_SYSTEM &&
-		    !(chrdev->options & PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE) &&
-		    chrdev->ops->set_stream_id)
-			ret = chrdev->ops->set_stream_id(chrdev,
-							 chrdev->params.stream_id);
-
-		if (chrdev->options & PTX_CHRDEV_WAIT_AFTER_LOCK)
-			msleep(200);
-
 		break;
 	}
 
 	case PTX_START_STREAMING:
-		if (chrdev->streaming) {
-			ret = -EALREADY;
-			break;
-		}
-
-		chrdev->ringbuf_write_size = 0;
-
-		if (chrdev->ops && chrdev->ops->set_capture)
-			ret = chrdev->ops->set_capture(chrdev, true);
-		else
-			ret = -ENOSYS;
-
-		if (!ret) {
-			ringbuffer_reset(chrdev->ringbuf);
-			ringbuffer_start(chrdev->ringbuf);
-			chrdev->streaming = true;
-		}
-
+		ret = ptx_chrdev_set_capture(chrdev, true);
 		break;
 
 	case PTX_STOP_STREAMING:
-		if (!chrdev->streaming) {
-			ret = -EALREADY;
-			break;
-		}
-
-		if (chrdev->ops && chrdev->ops->set_capture)
-			ret = chrdev->ops->set_capture(chrdev, false);
-		else
-			ret = -ENOSYS;
-
-		if (!ret) {
-			ringbuffer_stop(chrdev->ringbuf);
-			wake_up(&chrdev->ringbuf_wait);
-			chrdev->streaming = false;
-		}
-
+		ret = ptx_chrdev_set_capture(chrdev, false);
 		break;
 
 	case PTX_GET_CNR:
@@ -423,7 +1308,7 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 		if (ret)
 			break;
 
-		if (copy_to_user((void *)arg, &cn, sizeof(cn)))
+		if (copy_to_user((void __user *)arg, &cn, sizeof(cn)))
 			ret = -EFAULT;
 
 		break;
@@ -467,6 +1352,78 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 
 		break;
 
+	case PTXT_SET_READ_MODE:
+		switch (arg) {
+		case PTXT_READ_FULL:
+		case PTXT_READ_AVAILABLE:
+			chrdev->read_mode = arg;
+			break;
+
+		default:
+			ret = -EINVAL;
+			break;
+		}
+
+		break;
+
+	case PTXT_SET_DROP_POLICY:
+		ret = ptx_chrdev_set_drop_policy(chrdev, arg);
+		break;
+
+	case PTXT_SET_RINGBUF_SIZE:
+		ret = ptx_chrdev_set_ringbuf_size(chrdev, arg);
+		break;
+
+	case PTXT_SET_PID_FILTER:
+		ret = ptx_chrdev_set_pid_filter(chrdev, (void __user *)arg);
+		break;
+
+	case PTXT_CLEAR_PID_FILTER:
+		ptx_chrdev_clear_pid_filter(chrdev);
+		break;
+
+	case PTXT_SET_HW_PID_FILTER:
+		ret = ptx_chrdev_set_hw_pid_filter(chrdev, (void __user *)arg);
+		break;
+
+	case PTXT_SET_WAKEUP:
+	{
+		struct ptxt_wakeup wakeup;
+
+		if (copy_from_user(&wakeup, (void __user *)arg, sizeof(wakeup))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (wakeup.threshold > chrdev->ringbuf->size) {
+			ret = -EINVAL;
+			break;
+		}
+
+		WRITE_ONCE(chrdev->ringbuf_threshold_size,
+			   (wakeup.threshold) ? wakeup.threshold
+					      : ptx_chrdev_default_threshold_size(chrdev));
+		WRITE_ONCE(chrdev->wakeup_latency, wakeup.max_latency);
+
+		if (!wakeup.max_latency)
+			ptx_chrdev_cancel_wakeup_timer(chrdev);
+
+		break;
+	}
+
+	case PTXT_GET_WAKEUP:
+	{
+		struct ptxt_wakeup wakeup;
+
+		wakeup.threshold = chrdev->ringbuf_threshold_size;
+		wakeup.max_latency = chrdev->wakeup_latency;
+
+		if (copy_to_user((void __user *)arg, &wakeup, sizeof(wakeup)))
+			ret = -EFAULT;
+
+		break;
+	}
+
 	case PTX_SET_SYSTEM_MODE:
 	{
 		enum ptx_system_type mode = (enum ptx_system_type)arg;
@@ -489,31 +1446,44 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 		break;
 	}
 
-#if 0
 	case PTXT_GET_INFO:
+		ret = ptx_chrdev_get_info(chrdev, (void __user *)arg);
 		break;
 
 	case PTXT_GET_PARAMS:
+		ret = ptx_chrdev_get_params(chrdev, (void __user *)arg);
 		break;
 
 	case PTXT_SET_PARAMS:
+		ret = ptx_chrdev_set_params(chrdev, (void __user *)arg);
 		break;
 
 	case PTXT_CLEAR_PARAMS:
+		memset(&chrdev->params, 0, sizeof(chrdev->params));
+		chrdev->params.system = PTX_UNSPECIFIED_SYSTEM;
 		break;
 
 	case PTXT_TUNE:
+		if (chrdev->params.system == PTX_UNSPECIFIED_SYSTEM ||
+		    !chrdev->params.freq) {
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = ptx_chrdev_tune(chrdev, &chrdev->params);
 		break;
 
 	case PTXT_SET_LNB_VOLTAGE:
+		ret = ptx_chrdev_set_lnb_voltage(chrdev, (int)arg);
 		break;
 
 	case PTXT_SET_CAPTURE:
+		ret = ptx_chrdev_set_capture(chrdev, !!arg);
 		break;
 
 	case PTXT_READ_STATS:
+		ret = ptx_chrdev_read_stats(chrdev, (void __user *)arg);
 		break;
-#endif
 
 	default:
 		ret = -ENOSYS;
@@ -524,13 +1494,116 @@ static long ptx_chrdev_unlocked_ioctl(struct file *file,
 	return ret;
 }
 
+#ifdef CONFIG_COMPAT
+static long ptx_chrdev_compat_ioctl(struct file *file,
+				    unsigned int cmd, unsigned long arg)
+{
+	switch (cmd) {
+	case PTX_GET_CNR32:
+		cmd = PTX_GET_CNR;
+		break;
+
+	case PTXT_GET_INFO32:
+		cmd = PTXT_GET_INFO;
+		break;
+
+	/* the embedded pointers are converted by ptx_chrdev_copy_*_user() */
+	case PTXT_GET_PARAMS32:
+		cmd = PTXT_GET_PARAMS;
+		break;
+
+	case PTXT_SET_PARAMS32:
+		cmd = PTXT_SET_PARAMS;
+		break;
+
+	case PTXT_READ_STATS32:
+		cmd = PTXT_READ_STATS;
+		break;
+
+	default:
+		break;
+	}
+
+	return ptx_chrdev_unlocked_ioctl(file, cmd,
+					 (unsigned long)compat_ptr(arg));
+}
+#endif
+
 static struct file_operations ptx_chrdev_fops = {
 	.owner = THIS_MODULE,
 	.open = ptx_chrdev_open,
 	.read = ptx_chrdev_read,
+	.read_iter = ptx_chrdev_read_iter,
+	.splice_read = ptx_chrdev_splice_read,
+	.poll = ptx_chrdev_poll,
+	.mmap = ptx_chrdev_mmap,
 	.release = ptx_chrdev_release,
-	.unlocked_ioctl = ptx_chrdev_unlocked_ioctl
+	.unlocked_ioctl = ptx_chrdev_unlocked_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = ptx_chrdev_compat_ioctl
+#endif
+};
+
+static ssize_t dropped_bytes_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct ptx_chrdev *chrdev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n",
+			 (u64)atomic64_read(&chrdev->dropped_bytes));
+}
+static DEVICE_ATTR_RO(dropped_bytes);
+
+static ssize_t dropped_packets_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct ptx_chrdev *chrdev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n",
+			 (u64)atomic64_read(&chrdev->dropped_packets));
+}
+static DEVICE_ATTR_RO(dropped_packets);
+
+static const char * const ptx_chrdev_drop_policy_names[] = {
+	[PTXT_DROP_NEWEST] = "newest",
+	[PTXT_DROP_OLDEST] = "oldest",
+};
+
+static ssize_t drop_policy_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct ptx_chrdev *chrdev = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+			 ptx_chrdev_drop_policy_names[chrdev->drop_policy]);
+}
+
+static ssize_t drop_policy_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	int ret = 0;
+	struct ptx_chrdev *chrdev = dev_get_drvdata(dev);
+
+	ret = sysfs_match_string(ptx_chrdev_drop_policy_names, buf);
+	if (ret < 0)
+		return ret;
+
+	ret = ptx_chrdev_set_drop_policy(chrdev, ret);
+	if (ret)
+		return ret;
+
+	return count;
+}
+static DEVICE_ATTR_RW(drop_policy);
+
+static struct attribute *ptx_chrdev_attrs[] = {
+	&dev_attr_dropped_bytes.attr,
+	&dev_attr_dropped_packets.attr,
+	&dev_attr_drop_policy.attr,
+	NULL
 };
+ATTRIBUTE_GROUPS(ptx_chrdev);
 
 static bool ptx_chrdev_search_context(unsigned int major,
 				      struct ptx_chrdev_context **chrdev_ctx)
@@ -821,14 +1894,36 @@ int ptx_chrdev_context_add_group(struct ptx_chrdev_context *chrdev_ctx,
 		atomic_set(&chrdev->open, 0);
 		chrdev->system_cap = chrdev_config->system_cap;
 		chrdev->current_system = PTX_UNSPECIFIED_SYSTEM;
+		chrdev->current_freq = 0;
 		chrdev->ops = chrdev_config->ops;
 		chrdev->parent = group;
 		memset(&chrdev->params, 0, sizeof(chrdev->params));
 		chrdev->options = chrdev_config->options;
+		chrdev->read_mode = PTXT_READ_FULL;
+		chrdev->drop_policy = PTXT_DROP_NEWEST;
+		atomic64_set(&chrdev->dropped_bytes, 0);
+		atomic64_set(&chrdev->dropped_packets, 0);
+		RCU_INIT_POINTER(chrdev->pid_filter, NULL);
+		chrdev->pid_filter_vec.num = 0;
+		chrdev->hw_pid_filter = false;
 		chrdev->streaming = false;
 		init_waitqueue_head(&chrdev->ringbuf_wait);
 		chrdev->ringbuf_threshold_size = chrdev_config->ringbuf_threshold_size;
+		chrdev->ringbuf_default_threshold_size = chrdev_config->ringbuf_threshold_size;
 		chrdev->ringbuf_write_size = 0;
+		chrdev->wakeup_latency = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+		hrtimer_setup(&chrdev->wakeup_timer, ptx_chrdev_wakeup_timer,
+			      CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+		hrtimer_init(&chrdev->wakeup_timer,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		chrdev->wakeup_timer.function = ptx_chrdev_wakeup_timer;
+#endif
+		atomic_set(&chrdev->wakeup_timer_armed, 0);
+		INIT_WORK(&chrdev->tune_work, ptx_chrdev_tune_work);
+		atomic_set(&chrdev->tune_state, PTXT_TUNE_IDLE);
+		chrdev->tune_result = 0;
 		chrdev->priv = chrdev_config->priv;
 
 		ret = ringbuffer_create(&chrdev->ringbuf);
@@ -840,6 +1935,11 @@ int ptx_chrdev_context_add_group(struct ptx_chrdev_context *chrdev_ctx,
 			break;
 		}
 
+		chrdev->ringbuf_default_size = chrdev_config->ringbuf_size;
+		chrdev->ringbuf_max_size = max_t(size_t,
+						 chrdev_config->ringbuf_max_size,
+						 chrdev_config->ringbuf_size);
+
 		ret = ringbuffer_alloc(chrdev->ringbuf,
 				       chrdev_config->ringbuf_size);
 		if (ret) {
@@ -851,6 +1951,8 @@ int ptx_chrdev_context_add_group(struct ptx_chrdev_context *chrdev_ctx,
 			break;
 		}
 
+		ringbuffer_set_drop_policy(chrdev->ringbuf, false, 188);
+
 		if (chrdev->ops->init) {
 			ret = chrdev->ops->init(chrdev);
 			if (ret) {
@@ -885,10 +1987,13 @@ int ptx_chrdev_context_add_group(struct ptx_chrdev_context *chrdev_ctx,
 
 	for (i = 0; i < num; i++) {
 		dev_info(dev, "/dev/%s%u\n", chrdev_ctx->devname, base + i);
-		device_create(chrdev_ctx->class, dev,
-			      MKDEV(MAJOR(chrdev_ctx->dev_base),
-				    group->minor_base + i),
-			      NULL, "%s%u", chrdev_ctx->devname, base + i);
+		snprintf(group->chrdev[i].name, sizeof(group->chrdev[i].name),
+			 "%s%u", chrdev_ctx->devname, base + i);
+		device_create_with_groups(chrdev_ctx->class, dev,
+					  MKDEV(MAJOR(chrdev_ctx->dev_base),
+						group->minor_base + i),
+					  &group->chrdev[i], ptx_chrdev_groups,
+					  "%s%u", chrdev_ctx->devname, base + i);
 	}
 
 	kref_init(&group->kref);
@@ -970,7 +2075,9 @@ static void ptx_chrdev_group_release(struct kref *kref)
 		if (chrdev->ops->term)
 			chrdev->ops->term(chrdev);
 
+		hrtimer_cancel(&chrdev->wakeup_timer);
 		ringbuffer_destroy(chrdev->ringbuf);
+		kfree(rcu_dereference_protected(chrdev->pid_filter, 1));
 		mutex_destroy(&chrdev->lock);
 	}
 
@@ -1026,20 +2133,183 @@ void ptx_chrdev_group_destroy(struct ptx_chrdev_group *chrdev_group)
 	return;
 }
 
+static void ptx_chrdev_stream_written(struct ptx_chrdev *chrdev, size_t len)
+{
+	size_t threshold = READ_ONCE(chrdev->ringbuf_threshold_size);
+	u32 latency = READ_ONCE(chrdev->wakeup_latency);
+
+	chrdev->ringbuf_write_size += len;
+
+	if (unlikely(chrdev->ringbuf_write_size >= threshold)) {
+		wake_up(&chrdev->ringbuf_wait);
+		chrdev->ringbuf_write_size -= threshold;
+
+		if (atomic_read(&chrdev->wakeup_timer_armed) &&
+		    hrtimer_try_to_cancel(&chrdev->wakeup_timer) == 1)
+			atomic_set(&chrdev->wakeup_timer_armed, 0);
+	} else if (latency && len &&
+		   ringbuffer_is_running(chrdev->ringbuf) &&
+		   !atomic_xchg(&chrdev->wakeup_timer_armed, 1)) {
+		/* flush a partially filled threshold after at most latency us */
+		hrtimer_start(&chrdev->wakeup_timer,
+			      ns_to_ktime((u64)latency * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+
+		/* the stream may have been stopped and the timer cancelled meanwhile */
+		smp_mb();
+		if (unlikely(!ringbuffer_is_running(chrdev->ringbuf)) &&
+		    hrtimer_try_to_cancel(&chrdev->wakeup_timer) == 1)
+			atomic_set(&chrdev->wakeup_timer_armed, 0);
+	}
+}
+
 int ptx_chrdev_put_stream(struct ptx_chrdev *chrdev, void *buf, size_t len)
+{
+	struct kvec vec;
+
+	vec.iov_base = buf;
+	vec.iov_len = len;
+
+	return ptx_chrdev_put_stream_vec(chrdev, &vec, 1);
+}
+
+static int ptx_chrdev_write_stream_vec(struct ptx_chrdev *chrdev,
+				       const struct kvec *vec,
+				       unsigned int num)
 {
 	int ret = 0;
+	size_t len, dropped;
 
-	ret = ringbuffer_write_atomic(chrdev->ringbuf, buf, &len);
+	ret = ringbuffer_write_atomic_vec(chrdev->ringbuf, vec, num,
+					  &len, &dropped);
 	if (unlikely(ret && ret != -EOVERFLOW))
 		return ret;
 
-	chrdev->ringbuf_write_size += len;
+	if (unlikely(dropped))
+		ptx_chrdev_count_dropped(chrdev, dropped);
 
-	if (unlikely(chrdev->ringbuf_write_size >= chrdev->ringbuf_threshold_size)) {
-		wake_up(&chrdev->ringbuf_wait);
-		chrdev->ringbuf_write_size -= chrdev->ringbuf_threshold_size;
+	ptx_chrdev_stream_written(chrdev, len);
+
+	return ret;
+}
+
+/* writes only the packets whose PID passes the filter */
+static int ptx_chrdev_write_stream_vec_filtered(struct ptx_chrdev *chrdev,
+						const struct ptx_chrdev_pid_filter *filter,
+						const struct kvec *vec,
+						unsigned int num)
+{
+	int ret = 0, r;
+	struct ptx_chrdev_stream_vec *sv = &chrdev->pid_filter_vec;
+	unsigned int i;
+
+	sv->num = 0;
+
+	for (i = 0; i < num; i++) {
+		u8 *p = vec[i].iov_base;
+		size_t remain = vec[i].iov_len;
+
+		for (; remain >= 188; p += 188, remain -= 188) {
+			u16 pid = ((p[1] & 0x1f) << 8) | p[2];
+
+			if (!(filter->bitmap[pid >> 3] & (1 << (pid & 7))))
+				continue;
+
+			if (likely(ptx_chrdev_stream_vec_append(sv, p, 188)))
+				continue;
+
+			/* keep the first error */
+			r = ptx_chrdev_write_stream_vec(chrdev, sv->vec, sv->num);
+			if (unlikely(r) && !ret)
+				ret = r;
+
+			sv->num = 0;
+			ptx_chrdev_stream_vec_append(sv, p, 188);
+		}
+	}
+
+	if (sv->num) {
+		r = ptx_chrdev_write_stream_vec(chrdev, sv->vec, sv->num);
+		if (unlikely(r) && !ret)
+			ret = r;
+
+		sv->num = 0;
 	}
 
 	return ret;
 }
+
+int ptx_chrdev_put_stream_vec(struct ptx_chrdev *chrdev,
+			      const struct kvec *vec, unsigned int num)
+{
+	int ret = 0;
+	struct ptx_chrdev_pid_filter *filter;
+
+	rcu_read_lock();
+
+	filter = rcu_dereference(chrdev->pid_filter);
+	if (unlikely(filter))
+		ret = ptx_chrdev_write_stream_vec_filtered(chrdev, filter,
+							   vec, num);
+	else
+		ret = ptx_chrdev_write_stream_vec(chrdev, vec, num);
+
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* no buffer is lent out while the PID filter has to see every packet */
+void *ptx_chrdev_get_stream_buffer(struct ptx_chrdev *chrdev, size_t len)
+{
+	if (rcu_access_pointer(chrdev->pid_filter))
+		return NULL;
+
+	return ringbuffer_reserve_atomic(chrdev->ringbuf, len);
+}
+
+bool ptx_chrdev_is_stream_buffer(struct ptx_chrdev *chrdev, const void *buf)
+{
+	return ringbuffer_contains(chrdev->ringbuf, buf);
+}
+
+int ptx_chrdev_commit_stream_buffer(struct ptx_chrdev *chrdev,
+				    void *buf, size_t len)
+{
+	int ret = 0;
+
+	ret = ringbuffer_commit_atomic(chrdev->ringbuf, buf, len);
+	if (unlikely(ret))
+		return ret;
+
+	ptx_chrdev_stream_written(chrdev, len);
+
+	return 0;
+}
+
+/* hands back a buffer whose commit has failed, no more buffers are lent out */
+void ptx_chrdev_release_stream_buffer(struct ptx_chrdev *chrdev, size_t len)
+{
+	ringbuffer_release_atomic(chrdev->ringbuf, len);
+}
+
+void ptx_chrdev_count_dropped(struct ptx_chrdev *chrdev, size_t len)
+{
+	atomic64_add(len, &chrdev->dropped_bytes);
+	atomic64_add(DIV_ROUND_UP(len, 188), &chrdev->dropped_packets);
+}
+
+/*
+ * buffers of len bytes must tile a DMA capable ring buffer and leave room
+ * to spare
+ */
+bool ptx_chrdev_check_stream_buffer(struct ptx_chrdev *chrdev,
+				    size_t len, unsigned int num)
+{
+	size_t size = chrdev->ringbuf->size;
+
+	if (!ringbuffer_is_contiguous(chrdev->ringbuf))
+		return false;
+
+	return (len && !(size % len) && size >= len * (num + 1));
+}
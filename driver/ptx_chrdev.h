@@ -13,8 +13,12 @@
 #include <linux/kref.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/uio.h>
+#include <linux/rcupdate.h>
 
 #include "ptx_ioctl.h"
 #include "ringbuffer.h"
@@ -26,6 +30,12 @@ struct ptx_tune_params {
 	u16 stream_id;
 };
 
+struct ptx_pid_filter {
+	bool block;
+	unsigned int num;
+	u16 pid[PTXT_HW_PID_FILTER_MAX];
+};
+
 struct ptx_chrdev;
 struct ptx_chrdev_group;
 struct ptx_chrdev_context;
@@ -43,6 +53,8 @@ struct ptx_chrdev_operations {
 	int (*read_signal_strength)(struct ptx_chrdev *chrdev, u32 *value);
 	int (*read_cnr)(struct ptx_chrdev *chrdev, u32 *value);
 	int (*read_cnr_raw)(struct ptx_chrdev *chrdev, u32 *value);
+	int (*set_pid_filter)(struct ptx_chrdev *chrdev,
+			      const struct ptx_pid_filter *filter);
 };
 
 #define PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE	0x00000010
@@ -55,10 +67,23 @@ struct ptx_chrdev_config {
 	const struct ptx_chrdev_operations *ops;
 	u32 options;
 	size_t ringbuf_size;
+	size_t ringbuf_max_size;
 	size_t ringbuf_threshold_size;
 	void *priv;
 };
 
+struct ptx_chrdev_pid_filter {
+	struct rcu_head rcu;
+	u8 bitmap[PTXT_PID_NUM / 8];
+};
+
+#define PTX_CHRDEV_STREAM_VEC_NUM	32
+
+struct ptx_chrdev_stream_vec {
+	unsigned int num;
+	struct kvec vec[PTX_CHRDEV_STREAM_VEC_NUM];
+};
+
 struct ptx_chrdev_group_config {
 	struct kref *owner_kref;
 	void (*owner_kref_release)(struct kref *);
@@ -75,15 +100,34 @@ struct ptx_chrdev {
 	char name[64];
 	enum ptx_system_type system_cap;
 	enum ptx_system_type current_system;
+	u32 current_freq;
 	const struct ptx_chrdev_operations *ops;
 	struct ptx_chrdev_group *parent;
 	struct ptx_tune_params params;
 	u32 options;
+	enum ptxt_read_mode read_mode;
+	enum ptxt_drop_policy drop_policy;
+	atomic64_t dropped_bytes;
+	atomic64_t dropped_packets;
+	struct ptx_chrdev_pid_filter __rcu *pid_filter;
+	struct ptx_chrdev_stream_vec pid_filter_vec;	// used by the stream writer only
+	bool hw_pid_filter;
 	bool streaming;
+	bool stream_ended;	// streaming has been started and stopped since open
 	struct ringbuffer *ringbuf;
+	size_t ringbuf_default_size;
+	size_t ringbuf_max_size;
 	wait_queue_head_t ringbuf_wait;
 	size_t ringbuf_threshold_size;
+	size_t ringbuf_default_threshold_size;
 	size_t ringbuf_write_size;
+	u32 wakeup_latency;	// us
+	struct hrtimer wakeup_timer;
+	atomic_t wakeup_timer_armed;
+	struct work_struct tune_work;
+	struct ptx_tune_params tune_params;
+	atomic_t tune_state;
+	int tune_result;
 	void *priv;
 };
 
@@ -132,5 +176,66 @@ int ptx_chrdev_context_remove_group(struct ptx_chrdev_context *chrdev_ctx,
 				    unsigned int minor_base);
 void ptx_chrdev_group_destroy(struct ptx_chrdev_group *chrdev_group);
 int ptx_chrdev_put_stream(struct ptx_chrdev *chrdev, void *buf, size_t len);
+int ptx_chrdev_put_stream_vec(struct ptx_chrdev *chrdev,
+			      const struct kvec *vec, unsigned int num);
+void *ptx_chrdev_get_stream_buffer(struct ptx_chrdev *chrdev, size_t len);
+bool ptx_chrdev_is_stream_buffer(struct ptx_chrdev *chrdev, const void *buf);
+int ptx_chrdev_commit_stream_buffer(struct ptx_chrdev *chrdev,
+				    void *buf, size_t len);
+void ptx_chrdev_release_stream_buffer(struct ptx_chrdev *chrdev, size_t len);
+void ptx_chrdev_count_dropped(struct ptx_chrdev *chrdev, size_t len);
+bool ptx_chrdev_check_stream_buffer(struct ptx_chrdev *chrdev,
+				    size_t len, unsigned int num);
+
+static inline int ptx_chrdev_stream_vec_flush(struct ptx_chrdev *chrdev,
+					      struct ptx_chrdev_stream_vec *sv)
+{
+	int ret = 0;
+
+	if (likely(sv->num)) {
+		ret = ptx_chrdev_put_stream_vec(chrdev, sv->vec, sv->num);
+		sv->num = 0;
+	}
+
+	return ret;
+}
+
+/* returns false if the vector is full and has to be written out first */
+static inline bool ptx_chrdev_stream_vec_append(struct ptx_chrdev_stream_vec *sv,
+						void *buf, size_t len)
+{
+	struct kvec *v;
+
+	if (likely(sv->num)) {
+		v = &sv->vec[sv->num - 1];
+
+		if (((u8 *)v->iov_base) + v->iov_len == buf) {
+			v->iov_len += len;
+			return true;
+		}
+
+		if (unlikely(sv->num == PTX_CHRDEV_STREAM_VEC_NUM))
+			return false;
+	}
+
+	v = &sv->vec[sv->num++];
+	v->iov_base = buf;
+	v->iov_len = len;
+
+	return true;
+}
+
+/* the buffer must remain valid until ptx_chrdev_stream_vec_flush() */
+static inline void ptx_chrdev_stream_vec_add(struct ptx_chrdev *chrdev,
+					     struct ptx_chrdev_stream_vec *sv,
+					     void *buf, size_t len)
+{
+	if (unlikely(!ptx_chrdev_stream_vec_append(sv, buf, len))) {
+		ptx_chrdev_stream_vec_flush(chrdev, sv);
+		ptx_chrdev_stream_vec_append(sv, buf, len);
+	}
+
+	return;
+}
 
 #endif
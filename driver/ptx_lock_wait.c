@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Lock detection polling for PTX devices (ptx_lock_wait.c)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#include "print_format.h"
+#include "ptx_lock_wait.h"
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+
+/* poll interval (us) for each attempt, the last one is repeated */
+static const unsigned int lock_wait_intervals[] = {
+	1000, 1000, 1000, 1000,
+	2000, 2000, 2000, 2000,
+	5000, 5000, 5000, 5000,
+	10000
+};
+
+/* upper bounds (ms) of the histogram buckets, the last bucket is unbounded */
+static const unsigned int lock_time_buckets[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000
+};
+
+#define LOCK_TIME_BUCKET_NUM	(ARRAY_SIZE(lock_time_buckets) + 1)
+
+static const char * const lock_stage_names[PTX_LOCK_STAGE_NUM] = {
+	"pll", "demod", "tmcc", "slot"
+};
+
+struct lock_time_histogram {
+	atomic_t count[LOCK_TIME_BUCKET_NUM];
+	atomic_t timeout;
+};
+
+/* [0]: ISDB-T, [1]: ISDB-S */
+static struct lock_time_histogram lock_time_hist[2][PTX_LOCK_STAGE_NUM];
+static struct dentry *lock_wait_debugfs_dir;
+
+void ptx_lock_wait_start(struct ptx_lock_wait *wait, unsigned int timeout)
+{
+	wait->start = ktime_get();
+	wait->timeout = timeout;
+	wait->count = 0;
+}
+
+unsigned int ptx_lock_wait_elapsed(const struct ptx_lock_wait *wait)
+{
+	return ktime_to_ms(ktime_sub(ktime_get(), wait->start));
+}
+
+bool ptx_lock_wait_next(struct ptx_lock_wait *wait)
+{
+	unsigned int interval;
+
+	if (ptx_lock_wait_elapsed(wait) >= wait->timeout)
+		return false;
+
+	if (wait->count < ARRAY_SIZE(lock_wait_intervals))
+		interval = lock_wait_intervals[wait->count++];
+	else
+		interval = lock_wait_intervals[ARRAY_SIZE(lock_wait_intervals) - 1];
+
+	usleep_range(interval, interval + (interval >> 2));
+
+	return true;
+}
+
+void ptx_lock_wait_record(const struct ptx_lock_wait *wait,
+			  enum ptx_system_type system,
+			  enum ptx_lock_stage stage, bool locked)
+{
+	struct lock_time_histogram *hist;
+	unsigned int elapsed, i;
+
+	switch (system) {
+	case PTX_ISDB_T_SYSTEM:
+		hist = &lock_time_hist[0][stage];
+		break;
+
+	case PTX_ISDB_S_SYSTEM:
+		hist = &lock_time_hist[1][stage];
+		break;
+
+	default:
+		return;
+	}
+
+	if (!locked) {
+		atomic_inc(&hist->timeout);
+		return;
+	}
+
+	elapsed = ptx_lock_wait_elapsed(wait);
+
+	for (i = 0; i < ARRAY_SIZE(lock_time_buckets); i++) {
+		if (elapsed < lock_time_buckets[i])
+			break;
+	}
+
+	atomic_inc(&hist->count[i]);
+}
+
+static int lock_time_show(struct seq_file *m, void *v)
+{
+	static const char * const system_names[2] = { "isdb-t", "isdb-s" };
+	unsigned int i, j, k;
+
+	seq_puts(m, "system stage");
+	for (k = 0; k < ARRAY_SIZE(lock_time_buckets); k++)
+		seq_printf(m, " <%ums", lock_time_buckets[k]);
+	seq_printf(m, " >=%ums timeout\n",
+		   lock_time_buckets[ARRAY_SIZE(lock_time_buckets) - 1]);
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < PTX_LOCK_STAGE_NUM; j++) {
+			struct lock_time_histogram *hist = &lock_time_hist[i][j];
+
+			seq_printf(m, "%s %s", system_names[i], lock_stage_names[j]);
+			for (k = 0; k < LOCK_TIME_BUCKET_NUM; k++)
+				seq_printf(m, " %d", atomic_read(&hist->count[k]));
+			seq_printf(m, " %d\n", atomic_read(&hist->timeout));
+		}
+	}
+
+	return 0;
+}
+
+static int lock_time_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lock_time_show, inode->i_private);
+}
+
+static const struct file_operations lock_time_fops = {
+	.owner = THIS_MODULE,
+	.open = lock_time_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release
+};
+
+void ptx_lock_wait_debugfs_init(void)
+{
+	lock_wait_debugfs_dir = debugfs_create_dir(KBUILD_MODNAME, NULL);
+	debugfs_create_file("lock_time", 0444, lock_wait_debugfs_dir, NULL,
+			    &lock_time_fops);
+}
+
+void ptx_lock_wait_debugfs_exit(void)
+{
+	debugfs_remove_recursive(lock_wait_debugfs_dir);
+	lock_wait_debugfs_dir = NULL;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Lock detection polling definitions for PTX devices (ptx_lock_wait.h)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#ifndef __PTX_LOCK_WAIT_H__
+#define __PTX_LOCK_WAIT_H__
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+
+#include "ptx_ioctl.h"
+
+enum ptx_lock_stage {
+	PTX_LOCK_STAGE_PLL = 0,
+	PTX_LOCK_STAGE_DEMOD,
+	PTX_LOCK_STAGE_TMCC,
+	PTX_LOCK_STAGE_SLOT,
+	PTX_LOCK_STAGE_NUM
+};
+
+struct ptx_lock_wait {
+	ktime_t start;
+	unsigned int timeout;	/* ms */
+	unsigned int count;
+};
+
+void ptx_lock_wait_start(struct ptx_lock_wait *wait, unsigned int timeout);
+bool ptx_lock_wait_next(struct ptx_lock_wait *wait);
+unsigned int ptx_lock_wait_elapsed(const struct ptx_lock_wait *wait);
+void ptx_lock_wait_record(const struct ptx_lock_wait *wait,
+			  enum ptx_system_type system,
+			  enum ptx_lock_stage stage, bool locked);
+
+void ptx_lock_wait_debugfs_init(void);
+void ptx_lock_wait_debugfs_exit(void);
+
+#endif
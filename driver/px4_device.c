@@ -13,13 +13,17 @@
 #include <linux/slab.h>
 
 #include "px4_device_params.h"
+#include "ts_sync.h"
 #include "firmware.h"
+#include "ptx_lock_wait.h"
+#include "r850_cal_cache.h"
 
 #define PX4_DEVICE_TS_SYNC_COUNT	4
 #define PX4_DEVICE_TS_SYNC_SIZE		(188 * PX4_DEVICE_TS_SYNC_COUNT)
 
 struct px4_stream_context {
 	struct ptx_chrdev *chrdev[PX4_CHRDEV_NUM];
+	struct ptx_chrdev_stream_vec vec[PX4_CHRDEV_NUM];
 	u8 remain_buf[PX4_DEVICE_TS_SYNC_SIZE];
 	size_t remain_len;
 };
@@ -58,6 +62,11 @@ static int px4_backend_set_power(struct px4_device *px4, bool state)
 	return 0;
 }
 
+static u64 px4_device_cal_cache_key(struct px4_device *px4)
+{
+	return (px4->serial.serial_number * 10) + px4->serial.dev_id;
+}
+
 static int px4_backend_init(struct px4_device *px4)
 {
 	int ret = 0, i;
@@ -75,13 +84,24 @@ static int px4_backend_init(struct px4_device *px4)
 
 		switch (chrdev4->chrdev->system_cap) {
 		case PTX_ISDB_T_SYSTEM:
+		{
+			struct r850_calibration cal;
+
 			ret = r850_init(&chrdev4->tuner.r850);
-			if (ret)
+			if (ret) {
 				dev_err(px4->dev,
 					"px4_backend_init: r850_init() failed. (i: %d, ret: %d)\n",
 					i, ret);
+				break;
+			}
+
+			/* skip IMR/LPF calibration if done before */
+			if (!r850_cal_cache_load(px4_device_cal_cache_key(px4),
+						 i, &cal))
+				r850_set_calibration(&chrdev4->tuner.r850, &cal);
 
 			break;
+		}
 
 		case PTX_ISDB_S_SYSTEM:
 			ret = rt710_init(&chrdev4->tuner.rt710);
@@ -114,8 +134,16 @@ static int px4_backend_term(struct px4_device *px4)
 
 		switch (chrdev4->chrdev->system_cap) {
 		case PTX_ISDB_T_SYSTEM:
+		{
+			struct r850_calibration cal;
+
+			if (!r850_get_calibration(&chrdev4->tuner.r850, &cal))
+				r850_cal_cache_store(px4_device_cal_cache_key(px4),
+						     i, &cal);
+
 			r850_term(&chrdev4->tuner.r850);
 			break;
+		}
 
 		case PTX_ISDB_S_SYSTEM:
 			rt710_term(&chrdev4->tuner.rt710);
@@ -131,41 +159,31 @@ static int px4_backend_term(struct px4_device *px4)
 	return 0;
 }
 
-static void px4_device_stream_process(struct ptx_chrdev **chrdev,
+static void px4_device_stream_process(struct px4_stream_context *stream_ctx,
 				      u8 **buf, u32 *len)
 {
 	u8 *p = *buf;
 	u32 remain = *len;
+	int i;
 
 	while (likely(remain)) {
-		u32 i;
-		bool sync_remain = false;
+		u32 o;
 
-		for (i = 0; i < PX4_DEVICE_TS_SYNC_COUNT; i++) {
-			if (likely(((i + 1) * 188) <= remain)) {
-				if (unlikely((p[i * 188] & 0x8f) != 0x07))
-					break;
-			} else {
-				sync_remain = true;
-				break;
-			}
-		}
+		o = ts_sync_search(p, remain, 0x8f, 0x07, PX4_DEVICE_TS_SYNC_COUNT);
+		p += o;
+		remain -= o;
 
-		if (unlikely(sync_remain))
+		if (unlikely(remain < PX4_DEVICE_TS_SYNC_SIZE))
 			break;
 
-		if (unlikely(i < PX4_DEVICE_TS_SYNC_COUNT)) {
-			p++;
-			remain--;
-			continue;
-		}
-
 		while (likely(remain >= 188 && ((p[0] & 0x8f) == 0x07))) {
 			u8 id = (p[0] & 0x70) >> 4;
 
 			if (likely(id && id < 5)) {
 				p[0] = 0x47;
-				ptx_chrdev_put_stream(chrdev[id - 1], p, 188);
+				ptx_chrdev_stream_vec_add(stream_ctx->chrdev[id - 1],
+							  &stream_ctx->vec[id - 1],
+							  p, 188);
 			}
 
 			p += 188;
@@ -173,6 +191,10 @@ static void px4_device_stream_process(struct ptx_chrdev **chrdev,
 		}
 	}
 
+	for (i = 0; i < PX4_CHRDEV_NUM; i++)
+		ptx_chrdev_stream_vec_flush(stream_ctx->chrdev[i],
+					    &stream_ctx->vec[i]);
+
 	*buf = p;
 	*len = remain;
 
@@ -194,7 +216,7 @@ static int px4_device_stream_handler(void *context, void *buf, u32 len)
 			memcpy(ctx_remain_buf + ctx_remain_len, p, t);
 			ctx_remain_len = PX4_DEVICE_TS_SYNC_SIZE;
 
-			px4_device_stream_process(stream_ctx->chrdev,
+			px4_device_stream_process(stream_ctx,
 						  &ctx_remain_buf,
 						  &ctx_remain_len);
 			if (likely(!ctx_remain_len)) {
@@ -211,7 +233,7 @@ static int px4_device_stream_handler(void *context, void *buf, u32 len)
 		}
 	}
 
-	px4_device_stream_process(stream_ctx->chrdev, &p, &remain);
+	px4_device_stream_process(stream_ctx, &p, &remain);
 
 	if (unlikely(remain)) {
 		memcpy(stream_ctx->remain_buf, p, remain);
@@ -581,12 +603,14 @@ static int px4_chrdev_release(struct ptx_chrdev *chrdev)
 static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 			     struct ptx_tune_params *params)
 {
-	int ret = 0, i;
+	int ret = 0;
+	struct ptx_lock_wait wait;
 	struct ptx_chrdev_group *chrdev_group = chrdev->parent;
 	struct px4_chrdev *chrdev4 = chrdev->priv;
 	struct px4_device *px4 = chrdev4->parent;
 	struct tc90522_demod *tc90522 = &chrdev4->tc90522;
 	struct r850_tuner *r850 = &chrdev4->tuner.r850;
+	struct tc90522_regbuf regbuf[3];
 	bool tuner_locked;
 
 	dev_dbg(px4->dev,
@@ -595,7 +619,7 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 	if (params->system != PTX_ISDB_T_SYSTEM)
 		return -EINVAL;
 
-	ret = tc90522_write_reg(tc90522, 0x47, 0x30);
+	ret = tc90522_write_reg_cached(tc90522, 0x47, 0x30);
 	if (ret)
 		return ret;
 
@@ -607,7 +631,7 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 		return ret;
 	}
 
-	ret = tc90522_write_reg(tc90522, 0x76, 0x0c);
+	ret = tc90522_write_reg_cached(tc90522, 0x76, 0x0c);
 	if (ret)
 		return ret;
 
@@ -619,14 +643,15 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 		return ret;
 	}
 
-	i = 50;
-	while (i--) {
+	ptx_lock_wait_start(&wait, 500);
+	do {
 		ret = r850_is_pll_locked(r850, &tuner_locked);
 		if (!ret && tuner_locked)
 			break;
+	} while (ptx_lock_wait_next(&wait));
 
-		msleep(10);
-	}
+	ptx_lock_wait_record(&wait, PTX_ISDB_T_SYSTEM, PTX_LOCK_STAGE_PLL,
+			     !ret && tuner_locked);
 
 	if (ret) {
 		dev_err(px4->dev,
@@ -643,8 +668,8 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 	}
 
 	dev_dbg(px4->dev,
-		"px4_chrdev_tune_t %u:%u: PLL is locked. count: %d\n",
-		chrdev_group->id, chrdev->id, i);
+		"px4_chrdev_tune_t %u:%u: PLL is locked. elapsed: %ums\n",
+		chrdev_group->id, chrdev->id, ptx_lock_wait_elapsed(&wait));
 
 	ret = tc90522_set_agc_t(tc90522, true);
 	if (ret) {
@@ -654,15 +679,11 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 		return ret;
 	}
 
-	ret = tc90522_write_reg(tc90522, 0x71, 0x21);
-	if (ret)
-		return ret;
-
-	ret = tc90522_write_reg(tc90522, 0x72, 0x25);
-	if (ret)
-		return ret;
+	tc90522_regbuf_set_val(&regbuf[0], 0x71, 0x21);
+	tc90522_regbuf_set_val(&regbuf[1], 0x72, 0x25);
+	tc90522_regbuf_set_val(&regbuf[2], 0x75, 0x08);
 
-	ret = tc90522_write_reg(tc90522, 0x75, 0x08);
+	ret = tc90522_write_multiple_regs(tc90522, regbuf, 3);
 	if (ret)
 		return ret;
 
@@ -672,7 +693,8 @@ static int px4_chrdev_tune_t(struct ptx_chrdev *chrdev,
 static int px4_chrdev_tune_s(struct ptx_chrdev *chrdev,
 			     struct ptx_tune_params *params)
 {
-	int ret = 0, i;
+	int ret = 0;
+	struct ptx_lock_wait wait;
 	struct ptx_chrdev_group *chrdev_group = chrdev->parent;
 	struct px4_chrdev *chrdev4 = chrdev->priv;
 	struct px4_device *px4 = chrdev4->parent;
@@ -697,11 +719,11 @@ static int px4_chrdev_tune_s(struct ptx_chrdev *chrdev,
 		return ret;
 	}
 
-	ret = tc90522_write_reg(tc90522, 0x8e, 0x06/*0x02*/);
+	ret = tc90522_write_reg_cached(tc90522, 0x8e, 0x06/*0x02*/);
 	if (ret)
 		return ret;
 
-	ret = tc90522_write_reg(tc90522, 0xa3, 0xf7);
+	ret = tc90522_write_reg_cached(tc90522, 0xa3, 0xf7);
 	if (ret)
 		return ret;
 
@@ -713,14 +735,15 @@ static int px4_chrdev_tune_s(struct ptx_chrdev *chrdev,
 		return ret;
 	}
 
-	i = 50;
-	while (i--) {
+	ptx_lock_wait_start(&wait, 500);
+	do {
 		ret = rt710_is_pll_locked(rt710, &tuner_locked);
 		if (!ret && tuner_locked)
 			break;
+	} while (ptx_lock_wait_next(&wait));
 
-		msleep(10);
-	}
+	ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM, PTX_LOCK_STAGE_PLL,
+			     !ret && tuner_locked);
 
 	if (ret) {
 		dev_err(px4->dev,
@@ -738,8 +761,9 @@ static int px4_chrdev_tune_s(struct ptx_chrdev *chrdev,
 
 	rt710_get_rf_signal_strength(rt710, &ss);
 	dev_dbg(px4->dev,
-		"px4_chrdev_tune_s %u:%u: PLL is locked. count: %d, signal strength: %d.%03ddBm\n",
-		chrdev_group->id, chrdev->id, i, ss / 1000, -ss % 1000);
+		"px4_chrdev_tune_s %u:%u: PLL is locked. elapsed: %ums, signal strength: %d.%03ddBm\n",
+		chrdev_group->id, chrdev->id, ptx_lock_wait_elapsed(&wait),
+		ss / 1000, -ss % 1000);
 
 	ret = tc90522_set_agc_s(tc90522, true);
 	if (ret) {
@@ -768,7 +792,8 @@ static int px4_chrdev_check_lock_s(struct ptx_chrdev *chrdev, bool *locked)
 
 static int px4_chrdev_set_stream_id_s(struct ptx_chrdev *chrdev, u16 stream_id)
 {
-	int ret = 0, i;
+	int ret = 0;
+	struct ptx_lock_wait wait;
 	struct ptx_chrdev_group *chrdev_group = chrdev->parent;
 	struct px4_chrdev *chrdev4 = chrdev->priv;
 	struct px4_device *px4 = chrdev4->parent;
@@ -780,15 +805,16 @@ static int px4_chrdev_set_stream_id_s(struct ptx_chrdev *chrdev, u16 stream_id)
 		chrdev_group->id, chrdev->id);
 
 	if (stream_id < 12) {
-		i = 100;
-		while (i--) {
+		ptx_lock_wait_start(&wait, 1000);
+		do {
 			ret = tc90522_tmcc_get_tsid_s(tc90522,
 						      stream_id, &tsid);
 			if ((!ret && tsid) || ret == -EINVAL)
 				break;
+		} while (ptx_lock_wait_next(&wait));
 
-			msleep(10);
-		}
+		ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM,
+				     PTX_LOCK_STAGE_TMCC, !ret && tsid);
 
 		if (ret) {
 			dev_err(px4->dev,
@@ -815,14 +841,15 @@ static int px4_chrdev_set_stream_id_s(struct ptx_chrdev *chrdev, u16 stream_id)
 
 	/* check slot */
 
-	i = 100;
-	while(i--) {
+	ptx_lock_wait_start(&wait, 1000);
+	do {
 		ret = tc90522_get_tsid_s(tc90522, &tsid2);
 		if (!ret && tsid2 == tsid)
 			break;
+	} while (ptx_lock_wait_next(&wait));
 
-		msleep(10);
-	}
+	ptx_lock_wait_record(&wait, PTX_ISDB_S_SYSTEM, PTX_LOCK_STAGE_SLOT,
+			     !ret && tsid2 == tsid);
 
 	if (tsid2 != tsid)
 		ret = -EAGAIN;
@@ -1022,6 +1049,15 @@ static int px4_chrdev_set_capture(struct ptx_chrdev *chrdev, bool status)
 			: px4_chrdev_stop_capture(chrdev);
 }
 
+static int px4_chrdev_read_signal_strength_s(struct ptx_chrdev *chrdev,
+					     u32 *value)
+{
+	struct px4_chrdev *chrdev4 = chrdev->priv;
+
+	return rt710_get_rf_signal_strength(&chrdev4->tuner.rt710,
+					    (s32 *)value);
+}
+
 static int px4_chrdev_read_cnr_raw_t(struct ptx_chrdev *chrdev, u32 *value)
 {
 	struct px4_chrdev *chrdev4 = chrdev->priv;
@@ -1036,6 +1072,18 @@ static int px4_chrdev_read_cnr_raw_s(struct ptx_chrdev *chrdev, u32 *value)
 	return tc90522_get_cn_s(&chrdev4->tc90522, (u16 *)value);
 }
 
+static int px4_chrdev_set_pid_filter(struct ptx_chrdev *chrdev,
+				     const struct ptx_pid_filter *filter)
+{
+	struct px4_chrdev *chrdev4 = chrdev->priv;
+
+	return it930x_set_pid_list(&chrdev4->parent->it930x, chrdev->id,
+				   filter && filter->block,
+				   (filter) ? filter->pid : NULL,
+				   (filter) ? filter->num : 0,
+				   px4_device_params.discard_null_packets);
+}
+
 static struct ptx_chrdev_operations px4_chrdev_t_ops = {
 	.init = px4_chrdev_init,
 	.term = px4_chrdev_term_t,
@@ -1048,7 +1096,8 @@ static struct ptx_chrdev_operations px4_chrdev_t_ops = {
 	.set_capture = px4_chrdev_set_capture,
 	.read_signal_strength = NULL,
 	.read_cnr = NULL,
-	.read_cnr_raw = px4_chrdev_read_cnr_raw_t
+	.read_cnr_raw = px4_chrdev_read_cnr_raw_t,
+	.set_pid_filter = px4_chrdev_set_pid_filter
 };
 
 static struct ptx_chrdev_operations px4_chrdev_s_ops = {
@@ -1061,9 +1110,10 @@ static struct ptx_chrdev_operations px4_chrdev_s_ops = {
 	.set_stream_id = px4_chrdev_set_stream_id_s,
 	.set_lnb_voltage = px4_chrdev_set_lnb_voltage_s,
 	.set_capture = px4_chrdev_set_capture,
-	.read_signal_strength = NULL,
+	.read_signal_strength = px4_chrdev_read_signal_strength_s,
 	.read_cnr = NULL,
-	.read_cnr_raw = px4_chrdev_read_cnr_raw_s
+	.read_cnr_raw = px4_chrdev_read_cnr_raw_s,
+	.set_pid_filter = px4_chrdev_set_pid_filter
 };
 
 static int px4_parse_serial_number(struct px4_serial_number *serial,
@@ -1128,6 +1178,7 @@ static int px4_device_load_config(struct px4_device *px4,
 		chrdev4->tc90522.i2c = &it930x->i2c_master[1];
 		chrdev4->tc90522.i2c_addr = input->i2c_addr;
 		chrdev4->tc90522.is_secondary = (i % 2) ? true : false;
+		chrdev4->tc90522.use_shadow = px4_device_params.reg_shadow;
 
 		switch (chrdev_config[i].system_cap) {
 		case PTX_ISDB_S_SYSTEM:
@@ -1272,6 +1323,7 @@ int px4_device_init(struct px4_device *px4, struct device *dev,
 			goto fail_device;
 
 		chrdev_config[i].ringbuf_size = 188 * px4_device_params.tsdev_max_packets;
+		chrdev_config[i].ringbuf_max_size = 188 * px4_device_params.tsdev_ringbuf_max_packets;
 		chrdev_config[i].ringbuf_threshold_size = chrdev_config[i].ringbuf_size / 10;
 		chrdev_config[i].priv = &px4->chrdev4[i];
 	}
@@ -1294,13 +1346,9 @@ int px4_device_init(struct px4_device *px4, struct device *dev,
 		goto fail_device;
 
 	if (use_mldev) {
-		if (px4_mldev_search(px4->serial.serial_number, &px4->mldev))
-			ret = px4_mldev_add(px4->mldev, px4);
-		else
-			ret = px4_mldev_alloc(&px4->mldev,
+		ret = px4_mldev_find_or_alloc(&px4->mldev,
 					      px4_device_params.multi_device_power_control_mode,
 					      px4, px4_backend_set_power);
-
 		if (ret)
 			goto fail_device;
 	} else {
@@ -23,11 +23,14 @@ static const struct {
 
 struct px4_device_param_set px4_device_params = {
 	.tsdev_max_packets = 2048,
+	.tsdev_ringbuf_max_packets = 8192,
 	.psb_purge_timeout = 2000,
 	.disable_multi_device_power_control = false,
 	.multi_device_power_control_mode = PX4_MLDEV_ALL_MODE,
 	.s_tuner_no_sleep = false,
-	.discard_null_packets = false
+	.discard_null_packets = false,
+	.direct_streaming = false,
+	.reg_shadow = true
 };
 
 static int set_multi_device_power_control_mode(const char *val,
@@ -71,6 +74,12 @@ module_param_named(tsdev_max_packets, px4_device_params.tsdev_max_packets,
 MODULE_PARM_DESC(tsdev_max_packets,
 		 "Maximum number of TS packets buffering in tsdev. (default: 2048)");
 
+module_param_named(tsdev_ringbuf_max_packets,
+		   px4_device_params.tsdev_ringbuf_max_packets,
+		   uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(tsdev_ringbuf_max_packets,
+		 "Maximum number of TS packets PTXT_SET_RINGBUF_SIZE can set. (default: 8192)");
+
 module_param_named(psb_purge_timeout, px4_device_params.psb_purge_timeout,
 		   int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
@@ -87,3 +96,13 @@ module_param_named(s_tuner_no_sleep, px4_device_params.s_tuner_no_sleep,
 
 module_param_named(discard_null_packets, px4_device_params.discard_null_packets,
 		   bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+module_param_named(direct_streaming, px4_device_params.direct_streaming,
+		   bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(direct_streaming,
+		 "Receive TS data directly into the ring buffer if possible. (default: N)");
+
+module_param_named(reg_shadow, px4_device_params.reg_shadow,
+		   bool, S_IRUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(reg_shadow,
+		 "Skip demodulator register writes of already known values. (default: Y)");
@@ -9,11 +9,14 @@
 
 struct px4_device_param_set {
 	unsigned int tsdev_max_packets;
+	unsigned int tsdev_ringbuf_max_packets;
 	int psb_purge_timeout;
 	bool disable_multi_device_power_control;
 	enum px4_mldev_mode multi_device_power_control_mode;
 	bool s_tuner_no_sleep;
 	bool discard_null_packets;
+	bool direct_streaming;
+	bool reg_shadow;
 };
 
 extern struct px4_device_param_set px4_device_params;
@@ -20,28 +20,22 @@ static bool px4_mldev_get_chrdev_status(struct px4_mldev *mldev,
 static bool px4_mldev_is_power_interlocking_required(struct px4_mldev *mldev,
 						     unsigned int dev_id);
 
-bool px4_mldev_search(unsigned long long serial_number,
-		      struct px4_mldev **mldev)
+static struct px4_mldev *px4_mldev_search_nolock(unsigned long long serial_number)
 {
 	struct px4_mldev *m;
 
-	*mldev = NULL;
-
-	mutex_lock(&px4_mldev_glock);
 	list_for_each_entry(m, &px4_mldev_list, list) {
-		if (m->serial_number == serial_number) {
-			*mldev = m;
-			break;
-		}
+		if (m->serial_number == serial_number)
+			return m;
 	}
-	mutex_unlock(&px4_mldev_glock);
 
-	return (*mldev) ? true : false;
+	return NULL;
 }
 
-int px4_mldev_alloc(struct px4_mldev **mldev,  enum px4_mldev_mode mode,
-		    struct px4_device *px4,
-		    int (*backend_set_power)(struct px4_device *, bool))
+static int px4_mldev_alloc_nolock(struct px4_mldev **mldev,
+				  enum px4_mldev_mode mode,
+				  struct px4_device *px4,
+				  int (*backend_set_power)(struct px4_device *, bool))
 {
 	int i, j;
 	unsigned int dev_id = px4->serial.dev_id - 1;
@@ -70,15 +64,41 @@ int px4_mldev_alloc(struct px4_mldev **mldev,  enum px4_mldev_mode mode,
 	}
 	m->backend_set_power = backend_set_power;
 
-	mutex_lock(&px4_mldev_glock);
 	list_add_tail(&m->list, &px4_mldev_list);
-	mutex_unlock(&px4_mldev_glock);
 
 	*mldev = m;
 
 	return 0;
 }
 
+int px4_mldev_find_or_alloc(struct px4_mldev **mldev,
+			    enum px4_mldev_mode mode,
+			    struct px4_device *px4,
+			    int (*backend_set_power)(struct px4_device *, bool))
+{
+	int ret = 0;
+	struct px4_mldev *m;
+
+	*mldev = NULL;
+
+	/* the lookup and the insertion must be atomic against other probes */
+	mutex_lock(&px4_mldev_glock);
+
+	m = px4_mldev_search_nolock(px4->serial.serial_number);
+	if (m) {
+		ret = px4_mldev_add(m, px4);
+		if (!ret)
+			*mldev = m;
+	} else {
+		ret = px4_mldev_alloc_nolock(mldev, mode, px4,
+					     backend_set_power);
+	}
+
+	mutex_unlock(&px4_mldev_glock);
+
+	return ret;
+}
+
 static void px4_mldev_release(struct kref *kref)
 {
 	struct px4_mldev *mldev = container_of(kref, struct px4_mldev, kref);
@@ -86,7 +106,7 @@ static void px4_mldev_release(struct kref *kref)
 	pr_debug("px4_mldev_release: serial_number: %014llu\n",
 		 mldev->serial_number);
 
-	mutex_lock(&px4_mldev_glock);
+	/* called with px4_mldev_glock held */
 	list_del(&mldev->list);
 	mutex_unlock(&px4_mldev_glock);
 
@@ -175,10 +195,10 @@ int px4_mldev_remove(struct px4_mldev *mldev, struct px4_device *px4)
 		mldev->power_state[other_dev_id] = false;
 	}
 
-	if (kref_put(&mldev->kref, px4_mldev_release))
-		return 0;
-
 	mutex_unlock(&mldev->lock);
+
+	/* px4_mldev_glock is taken before mldev->lock by px4_mldev_find_or_alloc() */
+	kref_put_mutex(&mldev->kref, px4_mldev_release, &px4_mldev_glock);
 	return 0;
 }
 
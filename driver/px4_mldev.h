@@ -34,11 +34,10 @@ struct px4_mldev {
 	int (*backend_set_power)(struct px4_device *px4, bool state);
 };
 
-bool px4_mldev_search(unsigned long long serial_number,
-		      struct px4_mldev **mldev);
-int px4_mldev_alloc(struct px4_mldev **mldev, enum px4_mldev_mode mode,
-		    struct px4_device *px4,
-		    int (*backend_set_power)(struct px4_device *, bool));
+int px4_mldev_find_or_alloc(struct px4_mldev **mldev,
+			    enum px4_mldev_mode mode,
+			    struct px4_device *px4,
+			    int (*backend_set_power)(struct px4_device *, bool));
 int px4_mldev_add(struct px4_mldev *mldev, struct px4_device *px4);
 int px4_mldev_remove(struct px4_mldev *mldev, struct px4_device *px4);
 int px4_mldev_set_power(struct px4_mldev *mldev, struct px4_device *px4,
@@ -8,11 +8,16 @@
 #include "print_format.h"
 #include "px4_usb.h"
 
+#include <linux/version.h>
 #include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/completion.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/kobject.h>
 #include <linux/module.h>
 #include <linux/device.h>
 #include <linux/usb.h>
@@ -51,6 +56,12 @@
 
 struct px4_usb_context {
 	enum px4_usb_device_type type;
+	struct device *dev;
+	struct usb_device *usb_dev;
+	bool px4_use_mldev;
+	enum pxmlt_model pxmlt_model;
+	struct work_struct init_work;
+	bool ready;
 	struct completion quit_completion;
 	union {
 		struct px4_device px4;
@@ -60,6 +71,27 @@ struct px4_usb_context {
 };
 
 static struct ptx_chrdev_context *px4_usb_chrdev_ctx[6];
+static atomic_t px4_usb_handler_cpu_next = ATOMIC_INIT(0);
+
+static int px4_usb_get_handler_cpu(void)
+{
+	const struct cpumask *mask = &px4_usb_params.urb_handler_cpus;
+	unsigned int weight, n;
+	int cpu;
+
+	weight = cpumask_weight(mask);
+	if (!weight)
+		return -1;
+
+	n = ((unsigned int)atomic_inc_return(&px4_usb_handler_cpu_next) - 1) % weight;
+
+	for_each_cpu(cpu, mask) {
+		if (!n--)
+			return cpu;
+	}
+
+	return -1;
+}
 
 static int px4_usb_init_bridge(struct device *dev, struct usb_device *usb_dev,
 			       struct it930x_bridge *it930x)
@@ -70,17 +102,86 @@ static int px4_usb_init_bridge(struct device *dev, struct usb_device *usb_dev,
 	bus->type = ITEDTV_BUS_USB;
 	bus->usb.dev = usb_dev;
 	bus->usb.ctrl_timeout = 3000;
+	bus->usb.ctrl_delay = px4_usb_params.ctrl_delay;
 	bus->usb.streaming.urb_buffer_size = 188 * px4_usb_params.urb_max_packets;
 	bus->usb.streaming.urb_num = px4_usb_params.max_urbs;
 	bus->usb.streaming.no_dma = px4_usb_params.no_dma;
+	bus->usb.streaming.handler_mode = px4_usb_params.urb_handler;
+	bus->usb.streaming.handler_cpu = px4_usb_get_handler_cpu();
 
 	it930x->dev = dev;
 	it930x->config.xfer_size = 188 * px4_usb_params.xfer_packets;
 	it930x->config.i2c_speed = 0x07;
+	it930x->config.ctrl_delay_test = px4_usb_params.ctrl_delay_test;
 
 	return 0;
 }
 
+static void px4_usb_init_work(struct work_struct *work)
+{
+	int ret = 0;
+	struct px4_usb_context *ctx = container_of(work,
+						   struct px4_usb_context,
+						   init_work);
+	struct device *dev = ctx->dev;
+	char *envp[2];
+
+	switch (ctx->type) {
+	case PX4_USB_DEVICE:
+		ret = px4_device_init(&ctx->ctx.px4, dev,
+				      ctx->usb_dev->serial, ctx->px4_use_mldev,
+				      px4_usb_chrdev_ctx[PX4_USB_DEVICE],
+				      &ctx->quit_completion);
+		break;
+
+	case PXMLT5_USB_DEVICE:
+	case PXMLT8_USB_DEVICE:
+	case ISDB6014_4TS_USB_DEVICE:
+		ret = pxmlt_device_init(&ctx->ctx.pxmlt, dev, ctx->pxmlt_model,
+					px4_usb_chrdev_ctx[ctx->type],
+					&ctx->quit_completion);
+		break;
+
+	case ISDB2056_USB_DEVICE:
+		ret = isdb2056_device_init(&ctx->ctx.isdb2056, dev,
+					   px4_usb_chrdev_ctx[ISDB2056_USB_DEVICE],
+					   &ctx->quit_completion);
+		break;
+
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	if (ret)
+		dev_err(dev,
+			"px4_usb_init_work: Device initialization failed. (ret: %d)\n",
+			ret);
+
+	WRITE_ONCE(ctx->ready, !ret);
+
+	envp[0] = (ret) ? "PX4_READY=0" : "PX4_READY=1";
+	envp[1] = NULL;
+	kobject_uevent_env(&dev->kobj, KOBJ_CHANGE, envp);
+}
+
+static ssize_t ready_show(struct device *dev,
+			  struct device_attribute *attr, char *buf)
+{
+	struct px4_usb_context *ctx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", (ctx && READ_ONCE(ctx->ready)) ? 1 : 0);
+}
+
+static DEVICE_ATTR_RO(ready);
+
+static struct attribute *px4_usb_attrs[] = {
+	&dev_attr_ready.attr,
+	NULL
+};
+
+ATTRIBUTE_GROUPS(px4_usb);
+
 static int px4_usb_probe(struct usb_interface *intf,
 			 const struct usb_device_id *id)
 {
@@ -129,10 +230,7 @@ static int px4_usb_probe(struct usb_interface *intf,
 				break;
 
 			ctx->type = PX4_USB_DEVICE;
-			ret = px4_device_init(&ctx->ctx.px4, dev,
-					      usb_dev->serial, px4_use_mldev,
-					      px4_usb_chrdev_ctx[PX4_USB_DEVICE],
-					      &ctx->quit_completion);
+			ctx->px4_use_mldev = px4_use_mldev;
 			break;
 
 		case USB_PID_PX_MLT5U:
@@ -145,9 +243,7 @@ static int px4_usb_probe(struct usb_interface *intf,
 				break;
 
 			ctx->type = PXMLT5_USB_DEVICE;
-			ret = pxmlt_device_init(&ctx->ctx.pxmlt, dev, pxmlt5_model,
-						px4_usb_chrdev_ctx[PXMLT5_USB_DEVICE],
-						&ctx->quit_completion);
+			ctx->pxmlt_model = pxmlt5_model;
 			break;
 
 		case USB_PID_PX_MLT8PE3:
@@ -160,9 +256,7 @@ static int px4_usb_probe(struct usb_interface *intf,
 				break;
 
 			ctx->type = PXMLT8_USB_DEVICE;
-			ret = pxmlt_device_init(&ctx->ctx.pxmlt, dev, pxmlt8_model,
-						px4_usb_chrdev_ctx[PXMLT8_USB_DEVICE],
-						&ctx->quit_completion);
+			ctx->pxmlt_model = pxmlt8_model;
 			break;
 
 		case USB_PID_DIGIBEST_ISDB2056:
@@ -172,9 +266,6 @@ static int px4_usb_probe(struct usb_interface *intf,
 				break;
 
 			ctx->type = ISDB2056_USB_DEVICE;
-			ret = isdb2056_device_init(&ctx->ctx.isdb2056, dev,
-						   px4_usb_chrdev_ctx[ISDB2056_USB_DEVICE],
-						   &ctx->quit_completion);
 			break;
 
 		case USB_PID_DIGIBEST_ISDB6014_4TS:
@@ -184,9 +275,7 @@ static int px4_usb_probe(struct usb_interface *intf,
 				break;
 
 			ctx->type = ISDB6014_4TS_USB_DEVICE;
-			ret = pxmlt_device_init(&ctx->ctx.pxmlt, dev, ISDB6014_4TS_MODEL,
-						px4_usb_chrdev_ctx[ISDB6014_4TS_USB_DEVICE],
-						&ctx->quit_completion);
+			ctx->pxmlt_model = ISDB6014_4TS_MODEL;
 			break;
 
 		default:
@@ -205,9 +294,26 @@ static int px4_usb_probe(struct usb_interface *intf,
 	if (ret)
 		goto fail;
 
+	ctx->dev = dev;
+	ctx->usb_dev = usb_dev;
+	ctx->ready = false;
+	INIT_WORK(&ctx->init_work, px4_usb_init_work);
+
 	get_device(dev);
 	usb_set_intfdata(intf, ctx);
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0)
+	/* usb_driver.dev_groups is not available */
+	ret = device_add_groups(dev, px4_usb_groups);
+	if (ret)
+		dev_warn(dev,
+			 "px4_usb_probe: device_add_groups() failed. (ret: %d)\n",
+			 ret);
+#endif
+
+	/* the devices are initialized in parallel */
+	queue_work(system_unbound_wq, &ctx->init_work);
+
 	return 0;
 
 fail:
@@ -227,8 +333,17 @@ static void px4_usb_disconnect(struct usb_interface *intf)
 		return;
 	}
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0)
+	device_remove_groups(&intf->dev, px4_usb_groups);
+#endif
 	usb_set_intfdata(intf, NULL);
 
+	/* wait for the initialization to complete */
+	flush_work(&ctx->init_work);
+
+	if (!ctx->ready)
+		goto exit;
+
 	switch (ctx->type) {
 	case PX4_USB_DEVICE:
 		px4_device_term(&ctx->ctx.px4);
@@ -252,6 +367,7 @@ static void px4_usb_disconnect(struct usb_interface *intf)
 		break;
 	}
 
+exit:
 	dev_dbg(&intf->dev, "px4_usb_disconnect: release\n");
 
 	put_device(&intf->dev);
@@ -294,7 +410,10 @@ static struct usb_driver px4_usb_driver = {
 	.disconnect = px4_usb_disconnect,
 	.suspend = px4_usb_suspend,
 	.resume = px4_usb_resume,
-	.id_table = px4_usb_ids
+	.id_table = px4_usb_ids,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	.dev_groups = px4_usb_groups
+#endif
 };
 
 int px4_usb_register()
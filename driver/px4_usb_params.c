@@ -8,13 +8,87 @@
 #include "px4_usb_params.h"
 
 #include <linux/kernel.h>
+#include <linux/string.h>
 #include <linux/module.h>
 
+static const struct {
+	enum itedtv_usb_handler_mode mode;
+	char str[12];
+} urb_handler_table[] = {
+	{ ITEDTV_USB_HANDLER_COMPLETION, "completion" },
+	{ ITEDTV_USB_HANDLER_WORKQUEUE, "workqueue" },
+	{ ITEDTV_USB_HANDLER_THREAD, "thread" },
+};
+
 struct px4_usb_param_set px4_usb_params = {
 	.xfer_packets = 816,
 	.urb_max_packets = 816,
 	.max_urbs = 6,
-	.no_dma = false
+	.no_dma = false,
+	.ctrl_delay = 1000,
+	.ctrl_delay_test = false,
+#ifdef ITEDTV_BUS_USE_WORKQUEUE
+	.urb_handler = ITEDTV_USB_HANDLER_WORKQUEUE
+#else
+	.urb_handler = ITEDTV_USB_HANDLER_COMPLETION
+#endif
+};
+
+static int set_urb_handler(const char *val, const struct kernel_param *kp)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(urb_handler_table); i++) {
+		if (sysfs_streq(val, urb_handler_table[i].str)) {
+			px4_usb_params.urb_handler = urb_handler_table[i].mode;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int get_urb_handler(char *buffer, const struct kernel_param *kp)
+{
+	enum itedtv_usb_handler_mode mode = px4_usb_params.urb_handler;
+
+	if (mode >= ARRAY_SIZE(urb_handler_table))
+		return -EINVAL;
+
+	return scnprintf(buffer, 4096, "%s\n", urb_handler_table[mode].str);
+}
+
+static const struct kernel_param_ops urb_handler_ops = {
+	.set = set_urb_handler,
+	.get = get_urb_handler
+};
+
+static int set_urb_handler_cpus(const char *val,
+				const struct kernel_param *kp)
+{
+	int ret = 0;
+	cpumask_var_t mask;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = cpulist_parse(val, mask);
+	if (!ret)
+		cpumask_copy(&px4_usb_params.urb_handler_cpus, mask);
+
+	free_cpumask_var(mask);
+	return ret;
+}
+
+static int get_urb_handler_cpus(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, 4096, "%*pbl\n",
+			 cpumask_pr_args(&px4_usb_params.urb_handler_cpus));
+}
+
+static const struct kernel_param_ops urb_handler_cpus_ops = {
+	.set = set_urb_handler_cpus,
+	.get = get_urb_handler_cpus
 };
 
 module_param_named(xfer_packets, px4_usb_params.xfer_packets,
@@ -33,3 +107,23 @@ MODULE_PARM_DESC(max_urbs, "Maximum number of URBs. (default: 6)");
 
 module_param_named(no_dma, px4_usb_params.no_dma,
 		   bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+module_param_named(ctrl_delay, px4_usb_params.ctrl_delay,
+		   uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(ctrl_delay,
+		 "Delay in microseconds after each control transfer. 0 disables the delay. (default: 1000)");
+
+module_param_named(ctrl_delay_test, px4_usb_params.ctrl_delay_test,
+		   bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(ctrl_delay_test,
+		 "Measure the minimum safe control transfer delay of each device before its chrdevs are registered. (default: N)");
+
+module_param_cb(urb_handler, &urb_handler_ops,
+		NULL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(urb_handler,
+		 "Context to process received URBs in. (completion, workqueue or thread) (default: completion)");
+
+module_param_cb(urb_handler_cpus, &urb_handler_cpus_ops,
+		NULL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(urb_handler_cpus,
+		 "List of CPUs assigned to the URB handlers of each device in turn. (default: none)");
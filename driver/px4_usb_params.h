@@ -4,12 +4,19 @@
 #define __PX4_USB_PARAMS_H__
 
 #include <linux/types.h>
+#include <linux/cpumask.h>
+
+#include "itedtv_bus.h"
 
 struct px4_usb_param_set {
 	unsigned int xfer_packets;
 	unsigned int urb_max_packets;
 	unsigned int max_urbs;
 	bool no_dma;
+	unsigned int ctrl_delay;
+	bool ctrl_delay_test;
+	enum itedtv_usb_handler_mode urb_handler;
+	struct cpumask urb_handler_cpus;
 };
 
 extern struct px4_usb_param_set px4_usb_params;
@@ -13,6 +13,7 @@
 #include <linux/slab.h>
 
 #include "px4_device_params.h"
+#include "ts_sync.h"
 #include "firmware.h"
 
 #define PXMLT_DEVICE_TS_SYNC_COUNT	4
@@ -20,6 +21,7 @@
 
 struct pxmlt_stream_context {
 	struct ptx_chrdev *chrdev[PXMLT_CHRDEV_MAX_NUM];
+	struct ptx_chrdev_stream_vec vec[PXMLT_CHRDEV_MAX_NUM];
 	u8 remain_buf[PXMLT_DEVICE_TS_SYNC_SIZE];
 	size_t remain_len;
 };
@@ -107,41 +109,31 @@ static int pxmlt_backend_term(struct pxmlt_device *pxmlt)
 }
 #endif
 
-static void pxmlt_device_stream_process(struct ptx_chrdev **chrdev,
+static void pxmlt_device_stream_process(struct pxmlt_stream_context *stream_ctx,
 				      u8 **buf, u32 *len)
 {
 	u8 *p = *buf;
 	u32 remain = *len;
+	int i;
 
 	while (likely(remain)) {
-		u32 i;
-		bool sync_remain = false;
-
-		for (i = 0; i < PXMLT_DEVICE_TS_SYNC_COUNT; i++) {
-			if (likely(((i + 1) * 188) <= remain)) {
-				if (unlikely((p[i * 188] & 0x8f) != 0x07))
-					break;
-			} else {
-				sync_remain = true;
-				break;
-			}
-		}
+		u32 o;
 
-		if (unlikely(sync_remain))
-			break;
+		o = ts_sync_search(p, remain, 0x8f, 0x07, PXMLT_DEVICE_TS_SYNC_COUNT);
+		p += o;
+		remain -= o;
 
-		if (unlikely(i < PXMLT_DEVICE_TS_SYNC_COUNT)) {
-			p++;
-			remain--;
-			continue;
-		}
+		if (unlikely(remain < PXMLT_DEVICE_TS_SYNC_SIZE))
+			break;
 
 		while (likely(remain >= 188 && ((p[0] & 0x8f) == 0x07))) {
 			u8 id = (p[0] & 0x70) >> 4;
 
 			if (likely(id && id < 6)) {
 				p[0] = 0x47;
-				ptx_chrdev_put_stream(chrdev[id - 1], p, 188);
+				ptx_chrdev_stream_vec_add(stream_ctx->chrdev[id - 1],
+							  &stream_ctx->vec[id - 1],
+							  p, 188);
 			}
 
 			p += 188;
@@ -149,6 +141,10 @@ static void pxmlt_device_stream_process(struct ptx_chrdev **chrdev,
 		}
 	}
 
+	for (i = 0; i < PXMLT_CHRDEV_MAX_NUM; i++)
+		ptx_chrdev_stream_vec_flush(stream_ctx->chrdev[i],
+					    &stream_ctx->vec[i]);
+
 	*buf = p;
 	*len = remain;
 
@@ -170,7 +166,7 @@ static int pxmlt_device_stream_handler(void *context, void *buf, u32 len)
 			memcpy(ctx_remain_buf + ctx_remain_len, p, t);
 			ctx_remain_len = PXMLT_DEVICE_TS_SYNC_SIZE;
 
-			pxmlt_device_stream_process(stream_ctx->chrdev,
+			pxmlt_device_stream_process(stream_ctx,
 						  &ctx_remain_buf,
 						  &ctx_remain_len);
 			if (likely(!ctx_remain_len)) {
@@ -187,7 +183,7 @@ static int pxmlt_device_stream_handler(void *context, void *buf, u32 len)
 		}
 	}
 
-	pxmlt_device_stream_process(stream_ctx->chrdev, &p, &remain);
+	pxmlt_device_stream_process(stream_ctx, &p, &remain);
 
 	if (unlikely(remain)) {
 		memcpy(stream_ctx->remain_buf, p, remain);
@@ -836,6 +832,18 @@ static int pxmlt_chrdev_read_cnr_raw(struct ptx_chrdev *chrdev, u32 *value)
 	return ret;
 }
 
+static int pxmlt_chrdev_set_pid_filter(struct ptx_chrdev *chrdev,
+				       const struct ptx_pid_filter *filter)
+{
+	struct pxmlt_chrdev *chrdevm = chrdev->priv;
+
+	return it930x_set_pid_list(&chrdevm->parent->it930x, chrdev->id,
+				   filter && filter->block,
+				   (filter) ? filter->pid : NULL,
+				   (filter) ? filter->num : 0,
+				   px4_device_params.discard_null_packets);
+}
+
 static struct ptx_chrdev_operations pxmlt_chrdev_ops = {
 	.init = pxmlt_chrdev_init,
 	.term = pxmlt_chrdev_term,
@@ -848,7 +856,8 @@ static struct ptx_chrdev_operations pxmlt_chrdev_ops = {
 	.set_capture = pxmlt_chrdev_set_capture,
 	.read_signal_strength = NULL,
 	.read_cnr = NULL,
-	.read_cnr_raw = pxmlt_chrdev_read_cnr_raw
+	.read_cnr_raw = pxmlt_chrdev_read_cnr_raw,
+	.set_pid_filter = pxmlt_chrdev_set_pid_filter
 };
 
 static const struct {
@@ -909,6 +918,7 @@ static int pxmlt_device_load_config(struct pxmlt_device *pxmlt,
 		chrdevm->cxd2856er.i2c_addr.slvt = input->i2c_addr;
 		chrdevm->cxd2856er.config.xtal = 24000;
 		chrdevm->cxd2856er.config.tuner_i2c = true;
+		chrdevm->cxd2856er.config.use_shadow = px4_device_params.reg_shadow;
 
 		chrdevm->cxd2858er.dev = dev;
 		chrdevm->cxd2858er.i2c = &chrdevm->cxd2856er.i2c_master;
@@ -1012,6 +1022,7 @@ int pxmlt_device_init(struct pxmlt_device *pxmlt, struct device *dev,
 		chrdev_config[i].ops = &pxmlt_chrdev_ops;
 		chrdev_config[i].options = PTX_CHRDEV_SAT_SET_STREAM_ID_BEFORE_TUNE;
 		chrdev_config[i].ringbuf_size = 188 * px4_device_params.tsdev_max_packets;
+		chrdev_config[i].ringbuf_max_size = 188 * px4_device_params.tsdev_ringbuf_max_packets;
 		chrdev_config[i].ringbuf_threshold_size = chrdev_config[i].ringbuf_size / 10;
 		chrdev_config[i].priv = &pxmlt->chrdevm[i];
 	}
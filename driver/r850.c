@@ -73,12 +73,6 @@ static const u8 lpf_cal_regs[R850_NUM_REGS] = {
 	0xa3, 0x00, 0x0b, 0x44, 0x92, 0x1f, 0xe6, 0x80
 };
 
-struct r850_lpf_params {
-	u8 code;
-	u8 bandwidth;
-	u8 lsb;
-};
-
 struct r850_system_params {
 	enum r850_bandwidth bandwidth;
 	u32 if_freq;
@@ -1719,16 +1713,27 @@ static int r850_set_system_params(struct r850_tuner *t)
 			return -EINVAL;
 
 		if (!t->config.no_lpf_calibration) {
-			ret = r850_prepare_calibration(t,
-						       R850_CALIBRATION_LPF);
-			if (ret)
-				return ret;
+			if (!t->priv.lpf_cal_done ||
+			    memcmp(&t->priv.lpf_cal_sys, sys,
+				   sizeof(struct r850_system_config))) {
+				t->priv.lpf_cal_done = false;
+
+				ret = r850_prepare_calibration(t,
+							       R850_CALIBRATION_LPF);
+				if (ret)
+					return ret;
+
+				ret = r850_calibrate_lpf(t, prm->filt_cal_if,
+							 prm->bw, 2,
+							 &t->priv.lpf_cal);
+				if (ret)
+					return ret;
+
+				t->priv.lpf_cal_sys = *sys;
+				t->priv.lpf_cal_done = true;
+			}
 
-			ret = r850_calibrate_lpf(t,
-						 prm->filt_cal_if, prm->bw,
-						 2, &lpf);
-			if (ret)
-				return ret;
+			lpf = t->priv.lpf_cal;
 		} else {
 			lpf = prm->lpf;
 		}
@@ -2065,6 +2070,7 @@ int r850_init(struct r850_tuner *t)
 
 	t->priv.imr_cal[0].done = false;
 	t->priv.imr_cal[1].done = false;
+	t->priv.lpf_cal_done = false;
 
 	t->priv.sys_curr.system = R850_SYSTEM_UNDEFINED;
 
@@ -2120,6 +2126,7 @@ int r850_term(struct r850_tuner *t)
 
 	t->priv.imr_cal[0].done = false;
 	t->priv.imr_cal[1].done = false;
+	t->priv.lpf_cal_done = false;
 
 	t->priv.sys_curr.system = R850_SYSTEM_UNDEFINED;
 
@@ -2337,3 +2344,41 @@ int r850_is_pll_locked(struct r850_tuner *t, bool *locked)
 
 	return 0;
 }
+
+int r850_get_calibration(struct r850_tuner *t, struct r850_calibration *cal)
+{
+	if (!t->priv.init)
+		return -EINVAL;
+
+	mutex_lock(&t->priv.lock);
+
+	memcpy(cal->imr_cal, t->priv.imr_cal, sizeof(cal->imr_cal));
+	cal->lpf_cal_done = t->priv.lpf_cal_done;
+	cal->lpf_cal_sys = t->priv.lpf_cal_sys;
+	cal->lpf_cal = t->priv.lpf_cal;
+
+	mutex_unlock(&t->priv.lock);
+
+	return 0;
+}
+
+int r850_set_calibration(struct r850_tuner *t,
+			 const struct r850_calibration *cal)
+{
+	if (!t->priv.init)
+		return -EINVAL;
+
+	mutex_lock(&t->priv.lock);
+
+	memcpy(t->priv.imr_cal, cal->imr_cal, sizeof(t->priv.imr_cal));
+	t->priv.lpf_cal_done = cal->lpf_cal_done;
+	t->priv.lpf_cal_sys = cal->lpf_cal_sys;
+	t->priv.lpf_cal = cal->lpf_cal;
+
+	/* apply the calibration on the next r850_set_frequency() */
+	t->priv.sys_curr.system = R850_SYSTEM_UNDEFINED;
+
+	mutex_unlock(&t->priv.lock);
+
+	return 0;
+}
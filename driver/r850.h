@@ -60,6 +60,26 @@ struct r850_imr {
 	u8 value;
 };
 
+struct r850_imr_calibration {
+	struct r850_imr imr[5];
+	bool done;
+	bool result[5];
+	u8 mixer_amp_lpf;
+};
+
+struct r850_lpf_params {
+	u8 code;
+	u8 bandwidth;
+	u8 lsb;
+};
+
+struct r850_calibration {
+	struct r850_imr_calibration imr_cal[2];
+	bool lpf_cal_done;
+	struct r850_system_config lpf_cal_sys;
+	struct r850_lpf_params lpf_cal;
+};
+
 struct r850_priv {
 	struct mutex lock;
 	bool init;
@@ -70,12 +90,10 @@ struct r850_priv {
 	struct r850_system_config sys;
 	u8 mixer_mode;
 	u8 mixer_amp_lpf_imr_cal;
-	struct {
-		struct r850_imr imr[5];
-		bool done;
-		bool result[5];
-		u8 mixer_amp_lpf;
-	} imr_cal[2];
+	struct r850_imr_calibration imr_cal[2];
+	bool lpf_cal_done;
+	struct r850_system_config lpf_cal_sys;
+	struct r850_lpf_params lpf_cal;
 	struct r850_system_config sys_curr;
 };
 
@@ -99,6 +117,9 @@ int r850_set_system(struct r850_tuner *t,
 		    struct r850_system_config *system);
 int r850_set_frequency(struct r850_tuner *t, u32 freq);
 int r850_is_pll_locked(struct r850_tuner *t, bool *locked);
+int r850_get_calibration(struct r850_tuner *t, struct r850_calibration *cal);
+int r850_set_calibration(struct r850_tuner *t,
+			 const struct r850_calibration *cal);
 #ifdef __cplusplus
 }
 #endif
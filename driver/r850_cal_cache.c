@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * R850 calibration cache (r850_cal_cache.c)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#include "print_format.h"
+#include "r850_cal_cache.h"
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+struct r850_cal_cache_entry {
+	struct list_head list;
+	u64 serial;
+	unsigned int index;
+	struct r850_calibration cal;
+};
+
+static LIST_HEAD(cal_cache_list);
+static DEFINE_MUTEX(cal_cache_lock);
+
+static struct r850_cal_cache_entry *r850_cal_cache_search(u64 serial,
+							  unsigned int index)
+{
+	struct r850_cal_cache_entry *entry;
+
+	list_for_each_entry(entry, &cal_cache_list, list) {
+		if (entry->serial == serial && entry->index == index)
+			return entry;
+	}
+
+	return NULL;
+}
+
+int r850_cal_cache_load(u64 serial, unsigned int index,
+			struct r850_calibration *cal)
+{
+	int ret = 0;
+	struct r850_cal_cache_entry *entry;
+
+	mutex_lock(&cal_cache_lock);
+
+	entry = r850_cal_cache_search(serial, index);
+	if (entry)
+		memcpy(cal, &entry->cal, sizeof(*cal));
+	else
+		ret = -ENOENT;
+
+	mutex_unlock(&cal_cache_lock);
+
+	return ret;
+}
+
+int r850_cal_cache_store(u64 serial, unsigned int index,
+			 const struct r850_calibration *cal)
+{
+	int ret = 0;
+	struct r850_cal_cache_entry *entry;
+
+	mutex_lock(&cal_cache_lock);
+
+	entry = r850_cal_cache_search(serial, index);
+	if (!entry) {
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry) {
+			ret = -ENOMEM;
+			goto exit;
+		}
+
+		entry->serial = serial;
+		entry->index = index;
+		list_add_tail(&entry->list, &cal_cache_list);
+	}
+
+	memcpy(&entry->cal, cal, sizeof(entry->cal));
+
+exit:
+	mutex_unlock(&cal_cache_lock);
+
+	return ret;
+}
+
+void r850_cal_cache_clear(void)
+{
+	struct r850_cal_cache_entry *entry, *tmp;
+
+	mutex_lock(&cal_cache_lock);
+
+	list_for_each_entry_safe(entry, tmp, &cal_cache_list, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+
+	mutex_unlock(&cal_cache_lock);
+}
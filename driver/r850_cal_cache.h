@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * R850 calibration cache definitions (r850_cal_cache.h)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#ifndef __R850_CAL_CACHE_H__
+#define __R850_CAL_CACHE_H__
+
+#include <linux/types.h>
+
+#include "r850.h"
+
+int r850_cal_cache_load(u64 serial, unsigned int index,
+			struct r850_calibration *cal);
+int r850_cal_cache_store(u64 serial, unsigned int index,
+			 const struct r850_calibration *cal);
+void r850_cal_cache_clear(void);
+
+#endif
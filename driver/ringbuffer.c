@@ -7,8 +7,12 @@
 
 #include "ringbuffer.h"
 
+#include <linux/version.h>
+#include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 
 static void ringbuffer_free_nolock(struct ringbuffer *ringbuf);
@@ -22,15 +26,33 @@ int ringbuffer_create(struct ringbuffer **ringbuf)
 	if (!p)
 		return -ENOMEM;
 
+	p->ctrl = (struct ringbuffer_ctrl *)get_zeroed_page(GFP_KERNEL);
+	if (!p->ctrl) {
+		kfree(p);
+		return -ENOMEM;
+	}
+
 	atomic_set(&p->state, 0);
 	atomic_set(&p->rw_count, 0);
 	atomic_set(&p->wait_count, 0);
 	init_waitqueue_head(&p->wait);
+	mutex_init(&p->map_lock);
+	atomic_set(&p->map_count, 0);
 	p->buf = NULL;
 	p->size = 0;
-	atomic_set(&p->actual_size, 0);
-	atomic_set(&p->head, 0);
-	atomic_set(&p->tail, 0);
+	p->vmalloced = false;
+	p->rsv_tail = 0;
+	p->rsv_size = 0;
+	p->rsv_count = 0;
+	p->rsv_disabled = false;
+	mutex_init(&p->read_lock);
+	atomic_set(&p->busy, 0);
+	p->unit = 1;
+	p->drop_oldest = false;
+	p->ctrl->size = 0;
+	atomic_set(&p->ctrl->actual_size, 0);
+	atomic_set(&p->ctrl->head, 0);
+	atomic_set(&p->ctrl->tail, 0);
 
 	*ringbuf = p;
 
@@ -43,28 +65,66 @@ int ringbuffer_destroy(struct ringbuffer *ringbuf)
 
 	ringbuffer_lock(ringbuf);
 	ringbuffer_free_nolock(ringbuf);
+	free_page((unsigned long)ringbuf->ctrl);
+	mutex_destroy(&ringbuf->read_lock);
+	mutex_destroy(&ringbuf->map_lock);
 	kfree(ringbuf);
 
 	return 0;
 }
 
+/* falls back to vmalloc if physically contiguous pages are not available */
+static u8 *ringbuffer_alloc_buffer(size_t size, bool *vmalloced)
+{
+	u8 *buf;
+
+	buf = (u8 *)__get_free_pages(GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN,
+				     get_order(size));
+	if (buf) {
+		*vmalloced = false;
+		return buf;
+	}
+
+	buf = vmalloc_user(size);
+	if (buf)
+		*vmalloced = true;
+
+	return buf;
+}
+
+static void ringbuffer_free_buffer(u8 *buf, size_t size, bool vmalloced)
+{
+	if (vmalloced)
+		vfree(buf);
+	else
+		free_pages((unsigned long)buf, get_order(size));
+
+	return;
+}
+
 static void ringbuffer_free_nolock(struct ringbuffer *ringbuf)
 {
 	if (ringbuf->buf)
-		free_pages((unsigned long)ringbuf->buf,
-			   get_order(ringbuf->size));
+		ringbuffer_free_buffer(ringbuf->buf, ringbuf->size,
+				       ringbuf->vmalloced);
 
 	ringbuf->buf = NULL;
 	ringbuf->size = 0;
+	ringbuf->vmalloced = false;
+	ringbuf->ctrl->size = 0;
 
 	return;
 }
 
 static void ringbuffer_reset_nolock(struct ringbuffer *ringbuf)
 {
-	atomic_set(&ringbuf->actual_size, 0);
-	atomic_set(&ringbuf->head, 0);
-	atomic_set(&ringbuf->tail, 0);
+	atomic_set(&ringbuf->ctrl->actual_size, 0);
+	atomic_set(&ringbuf->ctrl->head, 0);
+	atomic_set(&ringbuf->ctrl->tail, 0);
+	ringbuf->rsv_tail = 0;
+	ringbuf->rsv_size = 0;
+	ringbuf->rsv_count = 0;
+	ringbuf->rsv_disabled = false;
 
 	return;
 }
@@ -85,35 +145,98 @@ static void ringbuffer_unlock(struct ringbuffer *ringbuf)
 	return;
 }
 
+#define RINGBUFFER_BUSY_READER	0x1
+#define RINGBUFFER_BUSY_WRITER	0x2
+
+/*
+ * keeps the writer from dropping data while the reader moves head
+ * the reader may sleep while copying, so the writer only tries to take it
+ */
+static int ringbuffer_begin_read(struct ringbuffer *ringbuf, bool nowait)
+{
+	if (!nowait)
+		mutex_lock(&ringbuf->read_lock);
+	else if (!mutex_trylock(&ringbuf->read_lock))
+		return -EAGAIN;
+
+	/* wait for a drop in progress, the writer wakes us up when it is done */
+	if (atomic_fetch_or_acquire(RINGBUFFER_BUSY_READER, &ringbuf->busy) &
+	    RINGBUFFER_BUSY_WRITER) {
+		if (nowait) {
+			atomic_fetch_andnot_release(RINGBUFFER_BUSY_READER,
+						    &ringbuf->busy);
+			mutex_unlock(&ringbuf->read_lock);
+			return -EAGAIN;
+		}
+
+		wait_event(ringbuf->wait,
+			   !(atomic_read_acquire(&ringbuf->busy) &
+			     RINGBUFFER_BUSY_WRITER));
+	}
+
+	return 0;
+}
+
+static void ringbuffer_end_read(struct ringbuffer *ringbuf)
+{
+	atomic_fetch_andnot_release(RINGBUFFER_BUSY_READER, &ringbuf->busy);
+	mutex_unlock(&ringbuf->read_lock);
+
+	return;
+}
+
 int ringbuffer_alloc(struct ringbuffer *ringbuf, size_t size)
 {
 	int ret = 0;
+	u8 *buf = NULL, *old_buf = NULL;
+	size_t old_size = 0;
+	bool vmalloced = false, old_vmalloced = false;
 
-	if (size > INT_MAX)
+	if (!size || size > INT_MAX)
 		return -EINVAL;
 
 	if (atomic_read_acquire(&ringbuf->state))
 		return -EBUSY;
 
-	ringbuffer_lock(ringbuf);
-
-	if (ringbuf->buf && ringbuf->size != size)
-		ringbuffer_free_nolock(ringbuf);
+	mutex_lock(&ringbuf->map_lock);
 
-	ringbuf->size = 0;
-	ringbuffer_reset_nolock(ringbuf);
+	if (atomic_read(&ringbuf->map_count)) {
+		ret = -EBUSY;
+		goto exit;
+	}
 
-	if (!ringbuf->buf) {
-		ringbuf->buf = (u8 *)__get_free_pages(GFP_KERNEL,
-						      get_order(size));
-		if (!ringbuf->buf)
+	/* allocate first so that a failure leaves the current buffer intact */
+	if (!ringbuf->buf || ringbuf->size != size) {
+		buf = ringbuffer_alloc_buffer(size, &vmalloced);
+		if (!buf) {
 			ret = -ENOMEM;
-		else
-			ringbuf->size = size;
+			goto exit;
+		}
 	}
 
+	ringbuffer_lock(ringbuf);
+
+	if (buf) {
+		old_buf = ringbuf->buf;
+		old_size = ringbuf->size;
+		old_vmalloced = ringbuf->vmalloced;
+
+		ringbuf->buf = buf;
+		ringbuf->size = size;
+		ringbuf->vmalloced = vmalloced;
+	}
+
+	ringbuffer_reset_nolock(ringbuf);
+	ringbuf->ctrl->size = ringbuf->size;
+
 	ringbuffer_unlock(ringbuf);
 
+	if (old_buf)
+		ringbuffer_free_buffer(old_buf, old_size, old_vmalloced);
+
+exit:
+	mutex_unlock(&ringbuf->map_lock);
+
 	return ret;
 }
 
@@ -122,11 +245,20 @@ int ringbuffer_free(struct ringbuffer *ringbuf)
 	if (atomic_read_acquire(&ringbuf->state))
 		return -EBUSY;
 
+	mutex_lock(&ringbuf->map_lock);
+
+	if (atomic_read(&ringbuf->map_count)) {
+		mutex_unlock(&ringbuf->map_lock);
+		return -EBUSY;
+	}
+
 	ringbuffer_lock(ringbuf);
 	ringbuffer_reset_nolock(ringbuf);
 	ringbuffer_free_nolock(ringbuf);
 	ringbuffer_unlock(ringbuf);
 
+	mutex_unlock(&ringbuf->map_lock);
+
 	return 0;
 }
 
@@ -166,26 +298,57 @@ int ringbuffer_ready_read(struct ringbuffer *ringbuf)
 	return 0;
 }
 
-int ringbuffer_read_user(struct ringbuffer *ringbuf,
-			 void __user *buf, size_t *len)
+enum ringbuffer_copy_mode {
+	RINGBUFFER_COPY_KERNEL = 0,
+	RINGBUFFER_COPY_USER,
+	RINGBUFFER_COPY_ITER,
+};
+
+/* returns the number of bytes not copied */
+static unsigned long ringbuffer_copy_out(void *dst, size_t offset,
+					 const void *src, unsigned long len,
+					 enum ringbuffer_copy_mode mode)
+{
+	switch (mode) {
+	case RINGBUFFER_COPY_USER:
+		return copy_to_user((u8 __user *)dst + offset, src, len);
+
+	case RINGBUFFER_COPY_ITER:
+		/* the iterator advances by itself */
+		return len - copy_to_iter(src, len, dst);
+
+	default:
+		memcpy((u8 *)dst + offset, src, len);
+		return 0;
+	}
+}
+
+static int _ringbuffer_read(struct ringbuffer *ringbuf,
+			    void *buf, size_t *len,
+			    enum ringbuffer_copy_mode mode, bool nowait)
 {
 	int ret = 0;
 	u8 *p;
-	size_t buf_size, actual_size, head, read_size;
+	size_t buf_size, actual_size, head, read_size = 0;
 
 	atomic_add_return_acquire(1, &ringbuf->rw_count);
 
+	ret = ringbuffer_begin_read(ringbuf, nowait);
+	if (ret)
+		goto exit;
+
 	p = ringbuf->buf;
 	buf_size = ringbuf->size;
-	actual_size = atomic_read_acquire(&ringbuf->actual_size);
-	head = atomic_read(&ringbuf->head);
+	actual_size = atomic_read_acquire(&ringbuf->ctrl->actual_size);
+	head = atomic_read(&ringbuf->ctrl->head);
 
 	read_size = (*len <= actual_size) ? *len : actual_size;
 	if (likely(read_size)) {
 		unsigned long res;
 
 		if (likely(head + read_size <= buf_size)) {
-			res = copy_to_user(buf, p + head, read_size);
+			res = ringbuffer_copy_out(buf, 0, p + head, read_size,
+						  mode);
 			if (unlikely(res)) {
 				read_size -= res;
 				ret = -EFAULT;
@@ -196,24 +359,30 @@ int ringbuffer_read_user(struct ringbuffer *ringbuf,
 		} else {
 			size_t tmp = buf_size - head;
 
-			res = copy_to_user(buf, p + head, tmp);
+			res = ringbuffer_copy_out(buf, 0, p + head, tmp, mode);
 			if (likely(!res))
-				res = copy_to_user(((u8 *)buf) + tmp, p,
-						   read_size - tmp);
+				res = ringbuffer_copy_out(buf, tmp, p,
+							  read_size - tmp, mode);
+			else
+				res += read_size - tmp;
 
 			if (unlikely(res)) {
 				read_size -= res;
 				ret = -EFAULT;
 			}
 
-			head = read_size - tmp;
+			head = (head + read_size >= buf_size) ? (head + read_size - buf_size)
+							      : (head + read_size);
 		}
 
-		atomic_xchg(&ringbuf->head, head);
+		atomic_xchg(&ringbuf->ctrl->head, head);
 		atomic_sub_return_release(read_size,
-					  &ringbuf->actual_size);
+					  &ringbuf->ctrl->actual_size);
 	}
 
+	ringbuffer_end_read(ringbuf);
+
+exit:
 	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
 	    atomic_read(&ringbuf->wait_count)))
 		wake_up(&ringbuf->wait);
@@ -223,12 +392,159 @@ int ringbuffer_read_user(struct ringbuffer *ringbuf,
 	return ret;
 }
 
+int ringbuffer_read_user(struct ringbuffer *ringbuf,
+			 void __user *buf, size_t *len)
+{
+	return _ringbuffer_read(ringbuf, (void __force *)buf, len,
+				RINGBUFFER_COPY_USER, false);
+}
+
+int ringbuffer_read(struct ringbuffer *ringbuf, void *buf, size_t *len)
+{
+	return _ringbuffer_read(ringbuf, buf, len, RINGBUFFER_COPY_KERNEL,
+				false);
+}
+
+int ringbuffer_read_iter(struct ringbuffer *ringbuf,
+			 struct iov_iter *to, size_t *len, bool nowait)
+{
+	return _ringbuffer_read(ringbuf, to, len, RINGBUFFER_COPY_ITER,
+				nowait);
+}
+
+int ringbuffer_consume(struct ringbuffer *ringbuf, size_t *len)
+{
+	size_t buf_size, actual_size, head, read_size;
+
+	atomic_add_return_acquire(1, &ringbuf->rw_count);
+	ringbuffer_begin_read(ringbuf, false);
+
+	buf_size = ringbuf->size;
+	actual_size = atomic_read_acquire(&ringbuf->ctrl->actual_size);
+	head = atomic_read(&ringbuf->ctrl->head);
+
+	read_size = (*len <= actual_size) ? *len : actual_size;
+	if (likely(read_size)) {
+		head += read_size;
+		if (head >= buf_size)
+			head -= buf_size;
+
+		atomic_xchg(&ringbuf->ctrl->head, head);
+		atomic_sub_return_release(read_size,
+					  &ringbuf->ctrl->actual_size);
+	}
+
+	ringbuffer_end_read(ringbuf);
+
+	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
+	    atomic_read(&ringbuf->wait_count)))
+		wake_up(&ringbuf->wait);
+
+	*len = read_size;
+
+	return 0;
+}
+
+static size_t ringbuffer_copy_nolock(u8 *p, size_t buf_size, size_t tail,
+				     const void *buf, size_t len)
+{
+	if (likely(tail + len <= buf_size)) {
+		memcpy(p + tail, buf, len);
+		tail = unlikely(tail + len == buf_size) ? 0 : (tail + len);
+	} else {
+		size_t tmp = buf_size - tail;
+
+		memcpy(p + tail, buf, tmp);
+		memcpy(p, ((u8 *)buf) + tmp, len - tmp);
+		tail = len - tmp;
+	}
+
+	return tail;
+}
+
 int ringbuffer_write_atomic(struct ringbuffer *ringbuf,
 			    const void *buf, size_t *len)
+{
+	struct kvec vec;
+	size_t dropped;
+
+	vec.iov_base = (void *)buf;
+	vec.iov_len = *len;
+
+	return ringbuffer_write_atomic_vec(ringbuf, &vec, 1, len, &dropped);
+}
+
+void ringbuffer_set_drop_policy(struct ringbuffer *ringbuf,
+				bool drop_oldest, size_t unit)
+{
+	WRITE_ONCE(ringbuf->unit, (unit) ? unit : 1);
+	WRITE_ONCE(ringbuf->drop_oldest, drop_oldest);
+
+	return;
+}
+
+/*
+ * discards whole units at head to make room for len bytes if possible
+ * *actual_size is updated with the size read after taking busy
+ */
+static size_t ringbuffer_drop_oldest_nolock(struct ringbuffer *ringbuf,
+					    size_t *actual_size, size_t len,
+					    size_t unit)
+{
+	size_t buf_size = ringbuf->size;
+	size_t size, head, drop = 0;
+
+	/* never wait for the reader */
+	if (atomic_read(&ringbuf->map_count) ||
+	    atomic_cmpxchg_acquire(&ringbuf->busy, 0, RINGBUFFER_BUSY_WRITER))
+		return 0;
+
+	/* the reader may have consumed data since the caller looked */
+	size = atomic_read_acquire(&ringbuf->ctrl->actual_size);
+	head = atomic_read(&ringbuf->ctrl->head);
+
+	if (size + len <= buf_size)
+		goto exit;
+
+	drop = roundup(size + len - buf_size, unit);
+	if (head % unit || drop > size) {
+		drop = 0;
+		goto exit;
+	}
+
+	head += drop;
+	if (head >= buf_size)
+		head -= buf_size;
+
+	atomic_xchg(&ringbuf->ctrl->head, head);
+	size = atomic_sub_return_release(drop, &ringbuf->ctrl->actual_size);
+
+exit:
+	*actual_size = size;
+
+	if (atomic_fetch_andnot_release(RINGBUFFER_BUSY_WRITER, &ringbuf->busy) &
+	    RINGBUFFER_BUSY_READER)
+		wake_up(&ringbuf->wait);
+
+	return drop;
+}
+
+int ringbuffer_write_atomic_vec(struct ringbuffer *ringbuf,
+				const struct kvec *vec, unsigned int num,
+				size_t *len, size_t *dropped)
 {
 	int ret = 0;
 	u8 *p;
-	size_t buf_size, actual_size, tail, write_size;
+	size_t buf_size, actual_size, tail, total_size, write_size;
+	size_t unit, drop_size = 0;
+	unsigned int i;
+
+	total_size = 0;
+	for (i = 0; i < num; i++)
+		total_size += vec[i].iov_len;
+
+	*len = 0;
+	*dropped = 0;
 
 	if (unlikely(atomic_read(&ringbuf->state) != 2))
 		return -EINVAL;
@@ -237,38 +553,280 @@ int ringbuffer_write_atomic(struct ringbuffer *ringbuf,
 
 	p = ringbuf->buf;
 	buf_size = ringbuf->size;
-	actual_size = atomic_read_acquire(&ringbuf->actual_size);
-	tail = atomic_read(&ringbuf->tail);
+	actual_size = atomic_read_acquire(&ringbuf->ctrl->actual_size);
+	tail = atomic_read(&ringbuf->ctrl->tail);
+
+	unit = READ_ONCE(ringbuf->unit);
+
+	if (unlikely(actual_size + total_size > buf_size) &&
+	    READ_ONCE(ringbuf->drop_oldest) && !ringbuf->rsv_count &&
+	    total_size <= buf_size) {
+		drop_size = ringbuffer_drop_oldest_nolock(ringbuf, &actual_size,
+							  total_size, unit);
+	}
+
+	/* truncate at unit granularity so that no packet is split */
+	write_size = likely(actual_size + total_size <= buf_size) ? total_size
+								  : rounddown(buf_size - actual_size, unit);
+
+	/* do not overwrite the area lent out by ringbuffer_reserve_atomic() */
+	if (unlikely(ringbuf->rsv_count))
+		write_size = 0;
 
-	write_size = likely(actual_size + *len <= buf_size) ? *len
-							    : (buf_size - actual_size);
 	if (likely(write_size)) {
-		if (likely(tail + write_size <= buf_size)) {
-			memcpy(p + tail, buf, write_size);
-			tail = unlikely(tail + write_size == buf_size) ? 0
-								       : (tail + write_size);
-		} else {
-			size_t tmp = buf_size - tail;
+		size_t remain = write_size;
+
+		for (i = 0; i < num && remain; i++) {
+			size_t l = (vec[i].iov_len <= remain) ? vec[i].iov_len
+							      : remain;
 
-			memcpy(p + tail, buf, tmp);
-			memcpy(p, ((u8 *)buf) + tmp, write_size - tmp);
-			tail = write_size - tmp;
+			tail = ringbuffer_copy_nolock(p, buf_size, tail,
+						      vec[i].iov_base, l);
+			remain -= l;
 		}
 
-		atomic_xchg(&ringbuf->tail, tail);
+		atomic_xchg(&ringbuf->ctrl->tail, tail);
 		atomic_add_return_release(write_size,
-					  &ringbuf->actual_size);
+					  &ringbuf->ctrl->actual_size);
 	}
 
 	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
 	    atomic_read(&ringbuf->wait_count)))
 		wake_up(&ringbuf->wait);
 
-	if (unlikely(*len != write_size))
+	if (unlikely(total_size != write_size || drop_size))
 		ret = -EOVERFLOW;
 
 	*len = write_size;
+	*dropped = (total_size - write_size) + drop_size;
+
+	return ret;
+}
+
+/* lends out the next contiguous len bytes of free space to the writer */
+void *ringbuffer_reserve_atomic(struct ringbuffer *ringbuf, size_t len)
+{
+	u8 *p = NULL;
+	size_t buf_size, actual_size, pos;
+
+	if (unlikely(atomic_read(&ringbuf->state) != 2 ||
+		     ringbuf->rsv_disabled))
+		return NULL;
+
+	atomic_add_return_acquire(1, &ringbuf->rw_count);
+
+	buf_size = ringbuf->size;
+	actual_size = atomic_read_acquire(&ringbuf->ctrl->actual_size);
+	pos = (ringbuf->rsv_count) ? ringbuf->rsv_tail
+				  : atomic_read(&ringbuf->ctrl->tail);
+
+	if (likely(actual_size + ringbuf->rsv_size + len <= buf_size &&
+		   pos + len <= buf_size)) {
+		p = ringbuf->buf + pos;
+		ringbuf->rsv_tail = (pos + len == buf_size) ? 0 : (pos + len);
+		ringbuf->rsv_size += len;
+		ringbuf->rsv_count++;
+	}
+
+	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
+	    atomic_read(&ringbuf->wait_count)))
+		wake_up(&ringbuf->wait);
+
+	return p;
+}
+
+/* reserved areas must be committed in the order they were reserved */
+int ringbuffer_commit_atomic(struct ringbuffer *ringbuf,
+			     const void *buf, size_t len)
+{
+	int ret = 0;
+	size_t tail;
+
+	atomic_add_return_acquire(1, &ringbuf->rw_count);
+
+	tail = atomic_read(&ringbuf->ctrl->tail);
+
+	if (unlikely(ringbuf->rsv_disabled)) {
+		ret = -ECANCELED;
+		goto exit;
+	}
+
+	if (unlikely(atomic_read(&ringbuf->state) != 2 ||
+		     !ringbuf->rsv_count || len > ringbuf->rsv_size ||
+		     buf != ringbuf->buf + tail)) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	ringbuf->rsv_size -= len;
+	ringbuf->rsv_count--;
+
+	tail += len;
+	if (tail == ringbuf->size)
+		tail = 0;
+
+	atomic_xchg(&ringbuf->ctrl->tail, tail);
+	atomic_add_return_release(len, &ringbuf->ctrl->actual_size);
+
+exit:
+	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
+	    atomic_read(&ringbuf->wait_count)))
+		wake_up(&ringbuf->wait);
+
+	return ret;
+}
+
+/*
+ * hands back a reserved area whose commit has failed, without publishing it
+ *
+ * The areas reserved after it can no longer be committed in order, so no area
+ * is lent out anymore until ringbuffer_reset(). The reservation state is only
+ * cleared once every lent area has been handed back, since the others may
+ * still be in use by DMA.
+ */
+void ringbuffer_release_atomic(struct ringbuffer *ringbuf, size_t len)
+{
+	atomic_add_return_acquire(1, &ringbuf->rw_count);
+
+	ringbuf->rsv_disabled = true;
+
+	if (likely(ringbuf->rsv_count)) {
+		ringbuf->rsv_size -= (len <= ringbuf->rsv_size) ? len
+								: ringbuf->rsv_size;
+		ringbuf->rsv_count--;
+	}
+
+	if (!ringbuf->rsv_count) {
+		ringbuf->rsv_tail = 0;
+		ringbuf->rsv_size = 0;
+	}
+
+	if (unlikely(!atomic_sub_return(1, &ringbuf->rw_count) &&
+	    atomic_read(&ringbuf->wait_count)))
+		wake_up(&ringbuf->wait);
+
+	return;
+}
+
+/* whether the buffer can be used for DMA directly */
+bool ringbuffer_is_contiguous(struct ringbuffer *ringbuf)
+{
+	return (ringbuf->buf && !ringbuf->vmalloced);
+}
+
+bool ringbuffer_contains(struct ringbuffer *ringbuf, const void *buf)
+{
+	return (buf >= (void *)ringbuf->buf &&
+		buf < (void *)(ringbuf->buf + ringbuf->size));
+}
+
+static void ringbuffer_vm_open(struct vm_area_struct *vma)
+{
+	struct ringbuffer *ringbuf = vma->vm_private_data;
+
+	atomic_inc(&ringbuf->map_count);
+}
+
+static void ringbuffer_vm_close(struct vm_area_struct *vma)
+{
+	struct ringbuffer *ringbuf = vma->vm_private_data;
+
+	atomic_dec(&ringbuf->map_count);
+}
+
+static const struct vm_operations_struct ringbuffer_vm_ops = {
+	.open = ringbuffer_vm_open,
+	.close = ringbuffer_vm_close
+};
+
+/* page 0: control page, page 1 and later: buffer */
+/* vmalloc'ed buffers are mapped page by page */
+static int ringbuffer_mmap_pages(struct ringbuffer *ringbuf,
+				 struct vm_area_struct *vma,
+				 unsigned long addr, unsigned long len,
+				 unsigned long pgoff)
+{
+	int ret = 0;
+
+	for (; len; addr += PAGE_SIZE, len -= PAGE_SIZE, pgoff++) {
+		struct page *page;
+
+		if (!pgoff)
+			page = virt_to_page(ringbuf->ctrl);
+		else
+			page = vmalloc_to_page(ringbuf->buf +
+					       ((pgoff - 1) << PAGE_SHIFT));
+
+		ret = vm_insert_page(vma, addr, page);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+int ringbuffer_mmap(struct ringbuffer *ringbuf, struct vm_area_struct *vma)
+{
+	int ret = 0;
+	unsigned long addr, len, pgoff, buf_pages;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	mutex_lock(&ringbuf->map_lock);
+
+	addr = vma->vm_start;
+	len = vma->vm_end - vma->vm_start;
+	pgoff = vma->vm_pgoff;
+	buf_pages = PAGE_ALIGN(ringbuf->size) >> PAGE_SHIFT;
 
+	if (pgoff > buf_pages || (len >> PAGE_SHIFT) > (buf_pages + 1 - pgoff)) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_mod(vma, VM_DONTEXPAND | VM_DONTDUMP, VM_MAYWRITE);
+#else
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	if (ringbuf->vmalloced) {
+		ret = ringbuffer_mmap_pages(ringbuf, vma, addr, len, pgoff);
+		if (ret)
+			goto exit;
+
+		goto map;
+	}
+
+	if (!pgoff) {
+		ret = remap_pfn_range(vma, addr,
+				      page_to_pfn(virt_to_page(ringbuf->ctrl)),
+				      PAGE_SIZE, vma->vm_page_prot);
+		if (ret)
+			goto exit;
+
+		addr += PAGE_SIZE;
+		len -= PAGE_SIZE;
+		pgoff++;
+	}
+
+	if (len) {
+		ret = remap_pfn_range(vma, addr,
+				      page_to_pfn(virt_to_page(ringbuf->buf)) + pgoff - 1,
+				      len, vma->vm_page_prot);
+		if (ret)
+			goto exit;
+	}
+
+map:
+	vma->vm_private_data = ringbuf;
+	vma->vm_ops = &ringbuffer_vm_ops;
+	atomic_inc(&ringbuf->map_count);
+
+exit:
+	mutex_unlock(&ringbuf->map_lock);
 	return ret;
 }
 
@@ -279,5 +837,10 @@ bool ringbuffer_is_running(struct ringbuffer *ringbuf)
 
 bool ringbuffer_is_readable(struct ringbuffer *ringbuf)
 {
-	return !!atomic_read_acquire(&ringbuf->actual_size);
+	return !!atomic_read_acquire(&ringbuf->ctrl->actual_size);
+}
+
+size_t ringbuffer_get_readable_size(struct ringbuffer *ringbuf)
+{
+	return atomic_read_acquire(&ringbuf->ctrl->actual_size);
 }
@@ -10,18 +10,38 @@
 
 #include <linux/types.h>
 #include <linux/atomic.h>
+#include <linux/mutex.h>
 #include <linux/wait.h>
+#include <linux/mm_types.h>
+#include <linux/uio.h>
+
+// shared with userspace through mmap (struct ptxt_ringbuf_ctrl)
+struct ringbuffer_ctrl {
+	u32 size;
+	atomic_t head;	// read
+	atomic_t tail;	// write
+	atomic_t actual_size;
+};
 
 struct ringbuffer {
 	atomic_t state;
 	atomic_t rw_count;
 	atomic_t wait_count;
 	wait_queue_head_t wait;
+	struct mutex map_lock;
+	atomic_t map_count;
 	u8 *buf;
 	size_t size;
-	atomic_t actual_size;
-	atomic_t head;	// read
-	atomic_t tail;	// write
+	bool vmalloced;
+	struct ringbuffer_ctrl *ctrl;
+	size_t rsv_tail;	// writer only
+	size_t rsv_size;	// writer only
+	unsigned int rsv_count;	// writer only, number of areas lent out
+	bool rsv_disabled;	// writer only, no area is lent out until reset
+	struct mutex read_lock;	// serializes the readers
+	atomic_t busy;		// bit 0: reader, bit 1: writer (dropping)
+	size_t unit;
+	bool drop_oldest;
 };
 
 int ringbuffer_create(struct ringbuffer **ringbuf);
@@ -34,8 +54,25 @@ int ringbuffer_stop(struct ringbuffer *ringbuf);
 int ringbuffer_ready_read(struct ringbuffer *ringbuf);
 int ringbuffer_read_user(struct ringbuffer *ringbuf,
 			 void __user *buf, size_t *len);
+int ringbuffer_read(struct ringbuffer *ringbuf, void *buf, size_t *len);
+int ringbuffer_read_iter(struct ringbuffer *ringbuf,
+			 struct iov_iter *to, size_t *len, bool nowait);
+int ringbuffer_consume(struct ringbuffer *ringbuf, size_t *len);
 int ringbuffer_write_atomic(struct ringbuffer *ringbuf,
 			    const void *buf, size_t *len);
+int ringbuffer_write_atomic_vec(struct ringbuffer *ringbuf,
+				const struct kvec *vec, unsigned int num,
+				size_t *len, size_t *dropped);
+void ringbuffer_set_drop_policy(struct ringbuffer *ringbuf,
+				bool drop_oldest, size_t unit);
+void *ringbuffer_reserve_atomic(struct ringbuffer *ringbuf, size_t len);
+int ringbuffer_commit_atomic(struct ringbuffer *ringbuf,
+			     const void *buf, size_t len);
+void ringbuffer_release_atomic(struct ringbuffer *ringbuf, size_t len);
+bool ringbuffer_contains(struct ringbuffer *ringbuf, const void *buf);
+bool ringbuffer_is_contiguous(struct ringbuffer *ringbuf);
+int ringbuffer_mmap(struct ringbuffer *ringbuf, struct vm_area_struct *vma);
+size_t ringbuffer_get_readable_size(struct ringbuffer *ringbuf);
 bool ringbuffer_is_readable(struct ringbuffer *ringbuf);
 bool ringbuffer_is_running(struct ringbuffer *ringbuf);
 
@@ -101,6 +101,30 @@ int tc90522_read_multiple_regs(struct tc90522_demod *demod,
 	return ret;
 }
 
+static void tc90522_invalidate_shadow_nolock(struct tc90522_demod *demod)
+{
+	memset(demod->priv.shadow_valid, 0, sizeof(demod->priv.shadow_valid));
+}
+
+static void tc90522_update_shadow_nolock(struct tc90522_demod *demod,
+					 u8 reg, const u8 *buf, int len,
+					 bool valid)
+{
+	struct tc90522_priv *priv = &demod->priv;
+	int i;
+
+	for (i = 0; i < len && reg + i < 256; i++) {
+		int r = reg + i;
+
+		if (valid) {
+			priv->shadow[r] = buf[i];
+			priv->shadow_valid[r / 8] |= (1 << (r % 8));
+		} else {
+			priv->shadow_valid[r / 8] &= ~(1 << (r % 8));
+		}
+	}
+}
+
 static int tc90522_write_regs_nolock(struct tc90522_demod *demod,
 				     u8 reg,
 				     u8 *buf, u8 len)
@@ -132,6 +156,9 @@ static int tc90522_write_regs_nolock(struct tc90522_demod *demod,
 			"tc90522_write_regs_nolock: i2c_comm_master_request() failed. (addr: 0x%x, reg: 0x%x, len: %u, ret: %d)\n",
 			demod->i2c_addr, reg, len, ret);
 
+	/* the registers are in an unknown state if the write has failed */
+	tc90522_update_shadow_nolock(demod, reg, buf, len, !ret);
+
 	return ret;
 }
 
@@ -168,28 +195,59 @@ int tc90522_write_reg(struct tc90522_demod *demod, u8 reg, u8 val)
 	return ret;
 }
 
+int tc90522_write_reg_cached(struct tc90522_demod *demod, u8 reg, u8 val)
+{
+	int ret = 0;
+	struct tc90522_priv *priv = &demod->priv;
+
+	mutex_lock(&priv->lock);
+
+	if (!demod->use_shadow ||
+	    !(priv->shadow_valid[reg / 8] & (1 << (reg % 8))) ||
+	    priv->shadow[reg] != val)
+		ret = tc90522_write_regs_nolock(demod, reg, &val, 1);
+
+	mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
 int tc90522_write_multiple_regs(struct tc90522_demod *demod,
 				struct tc90522_regbuf *regbuf, int num)
 {
-	int ret = 0, i;
+	int ret = 0, i, n;
+	u8 buf[254];
 
 	if (!regbuf || !num)
 		return -EINVAL;
 
 	mutex_lock(&demod->priv.lock);
 
-	for (i = 0; i < num; i++) {
-		if (regbuf[i].buf)
-			ret = tc90522_write_regs_nolock(demod,
-							regbuf[i].reg,
-							regbuf[i].buf,
-							regbuf[i].u.len);
-		else
-			ret = tc90522_write_regs_nolock(demod,
-							regbuf[i].reg,
-							&regbuf[i].u.val,
-							1);
+	for (i = 0; i < num; i += n) {
+		int reg = regbuf[i].reg, len = 0;
+
+		/* writes to consecutive registers are sent in one transfer */
+		for (n = 0; i + n < num; n++) {
+			struct tc90522_regbuf *r = &regbuf[i + n];
+			int l = (r->buf) ? r->u.len : 1;
+
+			if (n && (r->reg != reg + len ||
+				  len + l > (int)sizeof(buf)))
+				break;
+
+			if (!l || l > (int)sizeof(buf)) {
+				ret = -EINVAL;
+				break;
+			}
+
+			memcpy(&buf[len], (r->buf) ? r->buf : &r->u.val, l);
+			len += l;
+		}
+
+		if (ret)
+			break;
 
+		ret = tc90522_write_regs_nolock(demod, (u8)reg, buf, (u8)len);
 		if (ret)
 			break;
 	}
@@ -366,6 +424,7 @@ exit:
 int tc90522_init(struct tc90522_demod *demod)
 {
 	mutex_init(&demod->priv.lock);
+	tc90522_invalidate_shadow_nolock(demod);
 
 	demod->i2c_master.gate_ctrl = NULL;
 	demod->i2c_master.request = tc90522_i2c_master_request;
@@ -385,9 +444,17 @@ int tc90522_term(struct tc90522_demod *demod)
 	return 0;
 }
 
+static void tc90522_invalidate_shadow(struct tc90522_demod *demod)
+{
+	mutex_lock(&demod->priv.lock);
+	tc90522_invalidate_shadow_nolock(demod);
+	mutex_unlock(&demod->priv.lock);
+}
+
 int tc90522_sleep_s(struct tc90522_demod *demod, bool sleep)
 {
 #if 1
+	int ret = 0;
 	struct tc90522_regbuf regbuf[2] = {
 		{ 0x13, NULL, { 0x00 } },
 		{ 0x17, NULL, { 0x00 } }
@@ -399,7 +466,13 @@ int tc90522_sleep_s(struct tc90522_demod *demod, bool sleep)
 		regbuf[1].u.val = 0xff;
 	}
 
-	return tc90522_write_multiple_regs(demod, regbuf, 2);
+	ret = tc90522_write_multiple_regs(demod, regbuf, 2);
+
+	/* the register values are not tracked while sleeping */
+	if (sleep)
+		tc90522_invalidate_shadow(demod);
+
+	return ret;
 #else
 	return tc90522_write_reg(demod, 0x17, (sleep) ? 0x01 : 0x00);
 #endif
@@ -478,17 +551,13 @@ int tc90522_get_cn_s(struct tc90522_demod *demod, u16 *cn)
 
 int tc90522_enable_ts_pins_s(struct tc90522_demod *demod, bool e)
 {
-	struct tc90522_regbuf regbuf[] = {
-		{ 0x1c, NULL, { 0x00 } },
-		{ 0x1f, NULL, { 0x00 } }
-	};
+	int ret = 0;
 
-	if (!e) {
-		regbuf[0].u.val = 0x80;
-		regbuf[1].u.val = 0x22;
-	}
+	ret = tc90522_write_reg_cached(demod, 0x1c, (e) ? 0x00 : 0x80);
+	if (ret)
+		return ret;
 
-	return tc90522_write_multiple_regs(demod, regbuf, 2);
+	return tc90522_write_reg_cached(demod, 0x1f, (e) ? 0x00 : 0x22);
 }
 
 int tc90522_is_signal_locked_s(struct tc90522_demod *demod, bool *lock)
@@ -508,7 +577,14 @@ int tc90522_is_signal_locked_s(struct tc90522_demod *demod, bool *lock)
 int tc90522_sleep_t(struct tc90522_demod *demod, bool sleep)
 {
 #if 1
-	return tc90522_write_reg(demod, 0x03, (sleep) ? 0xf0 : 0x00);
+	int ret = 0;
+
+	ret = tc90522_write_reg(demod, 0x03, (sleep) ? 0xf0 : 0x00);
+
+	if (sleep)
+		tc90522_invalidate_shadow(demod);
+
+	return ret;
 #else
 	return tc90522_write_reg(demod, 0x03, (sleep) ? 0x90 : 0x80);
 #endif
@@ -544,7 +620,7 @@ int tc90522_get_cndat_t(struct tc90522_demod *demod, u32 *cndat)
 
 int tc90522_enable_ts_pins_t(struct tc90522_demod *demod, bool e)
 {
-	return tc90522_write_reg(demod, 0x1d, (e) ? 0x00 : 0xa8);
+	return tc90522_write_reg_cached(demod, 0x1d, (e) ? 0x00 : 0xa8);
 }
 
 int tc90522_is_signal_locked_t(struct tc90522_demod *demod, bool *lock)
@@ -20,6 +20,8 @@
 
 struct tc90522_priv {
 	struct mutex lock;
+	u8 shadow[256];
+	u8 shadow_valid[256 / 8];
 };
 
 struct tc90522_demod {
@@ -28,6 +30,7 @@ struct tc90522_demod {
 	u8 i2c_addr;
 	struct i2c_comm_master i2c_master;
 	bool is_secondary;
+	bool use_shadow;	// skip writes of known register values
 	struct tc90522_priv priv;
 };
 
@@ -67,6 +70,7 @@ int tc90522_write_regs(struct tc90522_demod *demod, u8 reg, u8 *buf, u8 len);
 int tc90522_write_reg(struct tc90522_demod *demod, u8 reg, u8 val);
 int tc90522_write_multiple_regs(struct tc90522_demod *demod,
 			        struct tc90522_regbuf *regbuf, int num);
+int tc90522_write_reg_cached(struct tc90522_demod *demod, u8 reg, u8 val);
 
 int tc90522_init(struct tc90522_demod *demod);
 int tc90522_term(struct tc90522_demod *demod);
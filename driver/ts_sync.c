@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * TS sync byte search (ts_sync.c)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#include "ts_sync.h"
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <asm/byteorder.h>
+
+#define TS_SYNC_BYTES(x)	(0x0101010101010101ULL * (x))
+
+static inline u64 ts_sync_load(const u8 *p)
+{
+	__le64 v;
+
+	memcpy(&v, p, sizeof(v));
+	return le64_to_cpu(v);
+}
+
+/* returns 0x80 in every byte of v which satisfies (byte & mask) == val */
+static inline u64 ts_sync_match(u64 v, u64 mask, u64 val)
+{
+	u64 x = (v & mask) ^ val;
+
+	return ~(((x & TS_SYNC_BYTES(0x7f)) + TS_SYNC_BYTES(0x7f)) | x | TS_SYNC_BYTES(0x7f));
+}
+
+/**
+ * ts_sync_search - find the first synchronized packet
+ * @buf: buffer
+ * @len: length of @buf
+ * @mask: mask applied to the first byte of each packet
+ * @val: expected value of the first byte after masking
+ * @count: number of consecutive packets to check
+ *
+ * Returns the smallest offset at which @count consecutive packets begin with
+ * the expected byte. If there is no such offset, returns the smallest offset
+ * at which all of the complete packets remaining in @buf begin with the
+ * expected byte (the caller should carry the remainder over to the next
+ * buffer), or @len.
+ */
+u32 ts_sync_search(const u8 *buf, u32 len, u8 mask, u8 val, u32 count)
+{
+	const u64 m = TS_SYNC_BYTES(mask), v = TS_SYNC_BYTES(val);
+	u32 o = 0;
+
+	if (likely(count && len >= TS_PACKET_SIZE * count)) {
+		u32 limit = len - (TS_PACKET_SIZE * count);
+
+		/* test 8 offsets at once, loads never cross the end of buf */
+		for (o = 0; o <= limit; o += 8) {
+			u64 r;
+			u32 i;
+
+			r = ts_sync_match(ts_sync_load(buf + o), m, v);
+			for (i = 1; r && i < count; i++)
+				r &= ts_sync_match(ts_sync_load(buf + o + (i * TS_PACKET_SIZE)), m, v);
+
+			if (likely(r)) {
+				u32 k = o + (__ffs64(r) >> 3);
+
+				if (likely(k <= limit))
+					return k;
+
+				break;
+			}
+		}
+
+		o = limit + 1;
+	}
+
+	for (; o < len; o++) {
+		u32 i;
+
+		for (i = 0; ((i + 1) * TS_PACKET_SIZE) <= (len - o); i++) {
+			if ((buf[o + (i * TS_PACKET_SIZE)] & mask) != val)
+				break;
+		}
+
+		if (((i + 1) * TS_PACKET_SIZE) > (len - o))
+			return o;
+	}
+
+	return len;
+}
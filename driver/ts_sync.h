@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * TS sync byte search definitions (ts_sync.h)
+ *
+ * Copyright (c) 2018-2021 nns779
+ */
+
+#ifndef __TS_SYNC_H__
+#define __TS_SYNC_H__
+
+#include <linux/types.h>
+
+#define TS_PACKET_SIZE	188
+
+u32 ts_sync_search(const u8 *buf, u32 len, u8 mask, u8 val, u32 count);
+
+#endif
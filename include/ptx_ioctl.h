@@ -5,6 +5,10 @@
 
 #include <linux/types.h>
 
+#if !defined(__KERNEL__) && !defined(__user)
+#define __user
+#endif
+
 // common definitions
 
 enum ptx_system_type {
@@ -60,23 +64,28 @@ struct ptxt_params {
 	enum ptx_system_type system;
 	__u32 freq;				// ISDB-T: Hz, ISDB-S/S3: kHz
 	__u32 num_prop;
-	struct ptxt_additional_param *prop;
+	struct ptxt_additional_param __user *prop;
 };
 
 enum ptxt_stat_code {
 	PTXT_UNKNOWN_STAT = 0,
 	PTXT_SIGNAL_STRENGTH_STAT,
-	PTXT_CNR_STAT
+	PTXT_CNR_STAT,
+	PTXT_CNR_RAW_STAT			// device specific, same as PTX_GET_CNR
 };
 
+// PTXT_READ_STATS fills every entry. A stat which cannot be read has its
+// 'result' set to a negative errno instead of failing the whole call.
+
 struct ptxt_stat {
 	enum ptxt_stat_code stat;
-	__u32 value;
+	__u32 value;				// signal strength: signed, 0.001 dBm
+	__s32 result;				// out: 0 or -errno
 };
 
 struct ptxt_stats {
 	__u32 num_stat;
-	struct ptxt_stat *stat;
+	struct ptxt_stat __user *stat;
 };
 
 #define PTXT_GET_INFO		_IOR(0xe7, 0x00, struct ptxt_info *)
@@ -88,4 +97,135 @@ struct ptxt_stats {
 #define PTXT_SET_CAPTURE	_IOW(0xe7, 0x06, bool)
 #define PTXT_READ_STATS		_IOR(0xe7, 0x07, struct ptxt_stats *)
 
+// mmap interface
+//
+// offset 0: control page (struct ptxt_ringbuf_ctrl, read-only)
+// offset PAGE_SIZE: ring buffer (ptxt_ringbuf_ctrl.size bytes, read-only)
+//
+// Readable data starts at 'head' and is 'actual_size' bytes long, which may
+// wrap around the end of the ring buffer. Consumed bytes must be released
+// with PTXT_CONSUME_RINGBUF.
+
+struct ptxt_ringbuf_ctrl {
+	__u32 size;
+	__u32 head;
+	__u32 tail;
+	__u32 actual_size;
+};
+
+struct ptxt_consume {
+	__u32 len;				// in: bytes to release, out: bytes released
+	__u32 available;			// out: readable bytes
+};
+
+#define PTXT_CONSUME_RINGBUF	_IOWR(0xe7, 0x08, struct ptxt_consume)
+
+// read mode
+
+enum ptxt_read_mode {
+	PTXT_READ_FULL = 0,			// wait until the buffer is filled (default)
+	PTXT_READ_AVAILABLE			// return what is available after the first wakeup
+};
+
+#define PTXT_SET_READ_MODE	_IOW(0xe7, 0x09, int)
+
+// overflow handling
+//
+// Data which does not fit in the ring buffer is dropped in whole packets.
+// PTXT_DROP_OLDEST discards the oldest packets instead, unless the ring
+// buffer is mapped or the reader is not at a packet boundary.
+//
+// Devices which receive directly into the ring buffer (ISDB2056) replace
+// the packets lost by a failed or unsynchronized transfer with null packets
+// (PID 0x1fff) to keep the buffer in order. Those are counted as dropped too.
+
+enum ptxt_drop_policy {
+	PTXT_DROP_NEWEST = 0,
+	PTXT_DROP_OLDEST
+};
+
+struct ptxt_drop_stats {
+	__u64 bytes;
+	__u64 packets;
+};
+
+#define PTXT_GET_DROP_STATS	_IOR(0xe7, 0x0a, struct ptxt_drop_stats)
+#define PTXT_SET_DROP_POLICY	_IOW(0xe7, 0x0b, int)
+
+// reader wakeup policy (reset on open)
+//
+// Readers are woken up every time threshold bytes have been written, and
+// no later than max_latency after data has been written. The latter only
+// bounds the latency of poll() and PTXT_READ_AVAILABLE readers.
+
+struct ptxt_wakeup {
+	__u32 threshold;			// bytes, 0: default
+	__u32 max_latency;			// microseconds, 0: disabled
+};
+
+#define PTXT_SET_WAKEUP		_IOW(0xe7, 0x0c, struct ptxt_wakeup)
+#define PTXT_GET_WAKEUP		_IOR(0xe7, 0x0d, struct ptxt_wakeup)
+
+// ring buffer size (restored on release)
+//
+// The size must be a multiple of the TS packet size (188 bytes).
+// It can only be changed while not streaming and not mapped.
+// The size is passed by value and must not exceed the maximum set with the
+// tsdev_ringbuf_max_packets module parameter (8192 packets by default).
+// The wakeup threshold is reset to the default for the new size.
+
+#define PTXT_SET_RINGBUF_SIZE	_IO(0xe7, 0x0e)
+
+// PID filter (cleared on release)
+//
+// Only TS packets whose PID bit is set (bitmap[pid / 8] & (1 << (pid % 8)))
+// are written to the ring buffer.
+
+#define PTXT_PID_NUM		8192
+
+struct ptxt_pid_filter {
+	__u8 bitmap[PTXT_PID_NUM / 8];
+};
+
+#define PTXT_SET_PID_FILTER	_IOW(0xe7, 0x0f, struct ptxt_pid_filter)
+#define PTXT_CLEAR_PID_FILTER	_IO(0xe7, 0x10)
+
+// hardware PID filter of the input port (reset on release)
+//
+// num == 0 restores the default filter.
+
+#define PTXT_HW_PID_FILTER_MAX	64
+
+struct ptxt_hw_pid_filter {
+	__u32 block;				// 0: pass, 1: block
+	__u32 num;
+	__u16 pid[PTXT_HW_PID_FILTER_MAX];
+};
+
+#define PTXT_SET_HW_PID_FILTER	_IOW(0xe7, 0x11, struct ptxt_hw_pid_filter)
+
+// asynchronous tune
+//
+// PTXT_TUNE_ASYNC starts tuning with the current parameters and returns
+// immediately. poll() reports POLLPRI once it has finished, until the
+// result is fetched with PTXT_GET_TUNE_STATUS.
+// While it is running, PTXT_TUNE_ASYNC and the other ioctls except
+// PTXT_CONSUME_RINGBUF, PTXT_GET_DROP_STATS and PTXT_GET_TUNE_STATUS fail
+// with EBUSY instead of blocking. poll() does not report POLLHUP before
+// streaming has been started and stopped once.
+
+enum ptxt_tune_state {
+	PTXT_TUNE_IDLE = 0,
+	PTXT_TUNE_BUSY,
+	PTXT_TUNE_DONE
+};
+
+struct ptxt_tune_status {
+	__u32 state;				// enum ptxt_tune_state
+	__s32 result;				// 0 or -errno (PTXT_TUNE_DONE only)
+};
+
+#define PTXT_TUNE_ASYNC		_IO(0xe7, 0x12)
+#define PTXT_GET_TUNE_STATUS	_IOR(0xe7, 0x13, struct ptxt_tune_status)
+
 #endif
@@ -0,0 +1,14 @@
+// asm/byteorder.h (userspace shim for ts_sync_test)
+
+#ifndef __SHIM_ASM_BYTEORDER_H__
+#define __SHIM_ASM_BYTEORDER_H__
+
+#include <linux/types.h>
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define le64_to_cpu(x)	__builtin_bswap64(x)
+#else
+#define le64_to_cpu(x)	((u64)(x))
+#endif
+
+#endif
@@ -0,0 +1,13 @@
+// linux/bitops.h (userspace shim for ts_sync_test)
+
+#ifndef __SHIM_LINUX_BITOPS_H__
+#define __SHIM_LINUX_BITOPS_H__
+
+#include <linux/types.h>
+
+static inline unsigned long __ffs64(u64 word)
+{
+	return __builtin_ctzll(word);
+}
+
+#endif
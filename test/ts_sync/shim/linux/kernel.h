@@ -0,0 +1,11 @@
+// linux/kernel.h (userspace shim for ts_sync_test)
+
+#ifndef __SHIM_LINUX_KERNEL_H__
+#define __SHIM_LINUX_KERNEL_H__
+
+#include <linux/types.h>
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#endif
@@ -0,0 +1,8 @@
+// linux/string.h (userspace shim for ts_sync_test)
+
+#ifndef __SHIM_LINUX_STRING_H__
+#define __SHIM_LINUX_STRING_H__
+
+#include <string.h>
+
+#endif
@@ -0,0 +1,16 @@
+// linux/types.h (userspace shim for ts_sync_test)
+
+#ifndef __SHIM_LINUX_TYPES_H__
+#define __SHIM_LINUX_TYPES_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t __le64;
+
+#endif
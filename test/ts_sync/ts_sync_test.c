@@ -0,0 +1,229 @@
+// ts_sync_test.c
+//
+// Checks that ts_sync_search() (driver/ts_sync.c) returns the same offsets
+// as the byte-by-byte resync loop which the PX4 and PX-MLT demuxers used
+// before, and measures both.
+//
+//	$ make test
+//	$ ./ts_sync_test [iterations] [rounds]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ts_sync.h"
+
+#define BUF_SIZE	(TS_PACKET_SIZE * 816)
+
+// the loop which ts_sync_search() replaced
+static uint32_t ts_sync_search_bytewise(const uint8_t *buf, uint32_t len,
+					uint8_t mask, uint8_t val,
+					uint32_t count)
+{
+	uint32_t o, i;
+
+	for (o = 0; o < len; o++) {
+		for (i = 0; i < count; i++) {
+			// fewer than count packets remain: carry them over
+			if (((i + 1) * TS_PACKET_SIZE) > (len - o))
+				return o;
+
+			if ((buf[o + (i * TS_PACKET_SIZE)] & mask) != val)
+				break;
+		}
+
+		if (i == count)
+			return o;
+	}
+
+	return len;
+}
+
+static uint32_t rand32(void)
+{
+	static uint64_t x = 0x2545f4914f6cdd1dULL;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return (uint32_t)(x >> 32);
+}
+
+static void fill_random(uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand32() & 0xff;
+}
+
+// packets at offset ofs, with a few sync bytes broken
+static void fill_stream(uint8_t *buf, uint32_t len, uint32_t ofs,
+			uint8_t sync, uint32_t errors)
+{
+	uint32_t i;
+
+	fill_random(buf, len);
+
+	for (i = ofs; i < len; i += TS_PACKET_SIZE)
+		buf[i] = sync;
+
+	if (len <= ofs)
+		return;
+
+	for (i = 0; i < errors; i++)
+		buf[ofs + ((rand32() % (((len - ofs - 1) / TS_PACKET_SIZE) + 1)) * TS_PACKET_SIZE)] ^= 0x80;
+}
+
+static int check(const uint8_t *buf, uint32_t len,
+		 uint8_t mask, uint8_t val, uint32_t count)
+{
+	uint32_t a, b;
+
+	a = ts_sync_search_bytewise(buf, len, mask, val, count);
+	b = ts_sync_search(buf, len, mask, val, count);
+
+	if (a == b)
+		return 0;
+
+	fprintf(stderr,
+		"mismatch: len: %u, mask: 0x%02x, val: 0x%02x, count: %u, bytewise: %u, ts_sync_search: %u\n",
+		len, mask, val, count, a, b);
+	return 1;
+}
+
+static int test_equivalence(uint8_t *buf, unsigned int iterations)
+{
+	static const struct {
+		uint8_t mask;
+		uint8_t val;
+	} syncs[] = {
+		{ 0xff, 0x47 },		// ISDB2056
+		{ 0x8f, 0x07 },		// PX4, PX-MLT (sync byte carries the stream id)
+	};
+	unsigned int n, failed = 0;
+
+	for (n = 0; n < iterations; n++) {
+		uint32_t s = n % 2;
+		uint32_t len = rand32() % (BUF_SIZE + 1);
+		uint32_t ofs = rand32() % (TS_PACKET_SIZE * 2);
+		uint32_t count = 1 + (rand32() % 8);
+		uint8_t sync = syncs[s].val | (rand32() & ~syncs[s].mask);
+
+		switch (n % 4) {
+		case 0:
+			fill_random(buf, len);
+			break;
+
+		case 1:
+			fill_stream(buf, len, 0, sync, 0);
+			break;
+
+		default:
+			fill_stream(buf, len, ofs, sync, rand32() % 8);
+			break;
+		}
+
+		// unaligned start
+		if (len && (n % 3) == 0) {
+			uint32_t skip = rand32() % 8;
+
+			if (skip > len)
+				skip = len;
+
+			failed += check(buf + skip, len - skip,
+					syncs[s].mask, syncs[s].val, count);
+		} else {
+			failed += check(buf, len, syncs[s].mask, syncs[s].val,
+					count);
+		}
+	}
+
+	printf("equivalence: %u cases, %u mismatches\n", iterations, failed);
+
+	return (failed) ? 1 : 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+// time to demux a whole buffer
+static void bench(const char *name, const uint8_t *buf, uint32_t len,
+		  unsigned int rounds)
+{
+	uint32_t (*const fn[2])(const uint8_t *, uint32_t, uint8_t, uint8_t, uint32_t) = {
+		ts_sync_search_bytewise,
+		ts_sync_search,
+	};
+	static const char *const fn_name[2] = { "bytewise", "ts_sync_search" };
+	volatile uint32_t sink = 0;
+	unsigned int f, r;
+
+	for (f = 0; f < 2; f++) {
+		double begin = now(), elapsed;
+
+		for (r = 0; r < rounds; r++) {
+			uint32_t o = 0;
+
+			// same as px4_device_stream_process()
+			while (o < len) {
+				o += fn[f](buf + o, len - o, 0x8f, 0x07, 4);
+				if ((len - o) < (TS_PACKET_SIZE * 4))
+					break;
+
+				while ((len - o) >= TS_PACKET_SIZE &&
+				       (buf[o] & 0x8f) == 0x07)
+					o += TS_PACKET_SIZE;
+			}
+
+			sink += o;
+		}
+
+		elapsed = now() - begin;
+		printf("%-8s %-16s %8.1f ns/packet\n", name, fn_name[f],
+		       (elapsed * 1e9) / ((double)rounds * (len / TS_PACKET_SIZE)));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int iterations = 20000, rounds = 2000;
+	uint8_t *buf;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+
+	if (argc > 2)
+		rounds = strtoul(argv[2], NULL, 0);
+
+	buf = malloc(BUF_SIZE);
+	if (!buf)
+		return 1;
+
+	if (test_equivalence(buf, iterations)) {
+		free(buf);
+		return 1;
+	}
+
+	if (rounds) {
+		fill_stream(buf, BUF_SIZE, 0, 0x07, 0);
+		bench("synced", buf, BUF_SIZE, rounds);
+
+		fill_stream(buf, BUF_SIZE, 0, 0x07, 64);
+		bench("errors", buf, BUF_SIZE, rounds);
+
+		fill_random(buf, BUF_SIZE);
+		bench("random", buf, BUF_SIZE, rounds / 20 + 1);
+	}
+
+	free(buf);
+	return 0;
+}